@@ -0,0 +1,33 @@
+/* Generated from abbrev.def by tools/abbrev-automaton.py, do not edit! */
+
+#pragma once
+
+#define ABBREV_FIRST_KEY 0x04
+#define ABBREV_KEYS 20
+#define ABBREV_CLASSES 5
+
+static const uint8_t PROGMEM abbrev_classes[] = {
+  1, 0, 0, 2, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 4,
+};
+
+static const uint8_t PROGMEM abbrev_next[][ABBREV_CLASSES] = {
+  {  0,  0,  1,  0,  0 }, // start
+  {  0,  2,  1,  0,  0 }, // KC_D
+  {  0,  0,  1,  0,  3 }, // KC_D KC_A
+  {  0,  0,  1,  4,  0 }, // KC_D KC_A KC_T
+  {  0,  0,  1,  0,  0 }, // KC_D KC_A KC_T KC_E
+};
+
+/* The abbreviation matched in each state, plus one; 0 if none. */
+static const uint8_t PROGMEM abbrev_match[] = {
+  0, 0, 0, 0, 1,
+};
+
+static const uint16_t PROGMEM abbrev_expansion_0[] = {
+  KC_SPC, KC_MINS, KC_D, KC_SPC, KC_QUOT, LSFT(KC_EQL), KC_4, KC_SPC, KC_D, KC_A, KC_Y, KC_S, KC_QUOT, 0
+};
+
+static const uint16_t * const PROGMEM abbrev_expansions[] = {
+  abbrev_expansion_0,
+};
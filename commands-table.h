@@ -0,0 +1,36 @@
+/* Generated from commands.def by tools/commands-table.py, do not edit! */
+
+#pragma once
+
+enum {
+  CMD_NONE = 0,
+  CMD_APPSEL_START = 0x01,
+  CMD_APPSEL_HELPER = 0x02,
+  CMD_APPSEL_SLACK = 0x03,
+  CMD_APPSEL_EMACS = 0x04,
+  CMD_APPSEL_TERM = 0x05,
+  CMD_APPSEL_CHROME = 0x06,
+  CMD_APPSEL_MUSIC = 0x07,
+  CMD_APPSEL_SOCIAL = 0x08,
+  CMD_APPSEL_PWMGR = 0x09,
+  CMD_APPSEL_SOCIAL2 = 0x0a,
+  CMD_REFLASH = 0x0b,
+  CMD_WM = 0x0c,
+};
+
+#define CMD_NAME_SIZE 15
+
+static const char PROGMEM command_names[][CMD_NAME_SIZE] = {
+  [CMD_APPSEL_START] = "appsel_start",
+  [CMD_APPSEL_HELPER] = "appsel_helper",
+  [CMD_APPSEL_SLACK] = "appsel_slack",
+  [CMD_APPSEL_EMACS] = "appsel_emacs",
+  [CMD_APPSEL_TERM] = "appsel_term",
+  [CMD_APPSEL_CHROME] = "appsel_chrome",
+  [CMD_APPSEL_MUSIC] = "appsel_music",
+  [CMD_APPSEL_SOCIAL] = "appsel_social",
+  [CMD_APPSEL_PWMGR] = "appsel_pwmgr",
+  [CMD_APPSEL_SOCIAL2] = "appsel_social2",
+  [CMD_REFLASH] = "reflash",
+  [CMD_WM] = "wm",
+};
@@ -24,4 +24,21 @@
 #undef LEADER_TIMEOUT
 #define LEADER_TIMEOUT 1000
 
+/* Macro playback: at most this many queued taps, this many ms apart */
+#define ANG_TAP_QUEUE_SIZE 64
+#define ANG_TAP_DELAY 50
+
+/* Keylogger: records buffered in RAM, flushed this many at a time, or when
+ * the oldest is this many ms old */
+#define KEYLOG_BUFFER_SIZE 32
+#define KEYLOG_BATCH_SIZE 8
+#define KEYLOG_FLUSH_TIMEOUT 250
+
+/* Unicode symbol input: the longest name that can be typed */
+#define UCIS_MAX_SYMBOL_LENGTH 32
+
+/* Hungarian layer: type accented characters with unicode input, instead of
+ * the compose key */
+// #define HUN_UNICODE_INPUT
+
 #endif
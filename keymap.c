@@ -3,6 +3,7 @@
  */
 
 #include <stdarg.h>
+#include <string.h>
 #include QMK_KEYBOARD_H
 #include "led.h"
 #include "debug.h"
@@ -13,6 +14,19 @@
 #include "eeconfig.h"
 #include "wait.h"
 #include "version.h"
+#include "leader-trie.h"
+#include "abbrev-automaton.h"
+#include "ucis-trie.h"
+#include "commands-table.h"
+#ifdef RAW_COMMANDS_ENABLE
+#include "raw_hid.h"
+#endif
+#if defined(STENO_GEMINI) || defined(STENO_TXBOLT)
+#include "virtser.h"
+#endif
+#if defined(LATENCY_STATS_ENABLE) || defined(PROFILE_ENABLE)
+#include "avr/timer_avr.h"
+#endif
 
 /* Layers */
 
@@ -26,52 +40,36 @@ enum {
   PLVR,
 };
 
-/* Macros */
+/* Key transforms: the rows of key_transforms[], the macros.def argument of
+ * the number row and Hungarian keys */
 
 enum {
-  NONE = 0,
-  // Buttons that do extra stuff
-  A_GUI,
-  A_PLVR,
-  A_MPN,
-
-  // Application select keys
-  APP_SLK,  // Slack
-  APP_EMCS, // Emacs
-  APP_TERM, // Terminal
-  APP_CHRM, // Chrome
-  APP_MSIC, // Music
-  APP_SOCL, // Social
-  APP_PMGR, // Password manager
-  APP_SCL2, // Social #2
-
-  // Hungarian layer keys
-  HU_AA, // Á
-  HU_OO, // Ó
-  HU_EE, // É
-  HU_UU, // Ú
-  HU_II, // Í
-  HU_OE, // Ö
-  HU_UE, // Ü
-  HU_OEE, // Ő
-  HU_UEE, // Ű
-
-  // number/symbol keys
-  A_1, // 1
-  A_2, // 2
-  A_3, // ...
-  A_4,
-  A_5,
-  A_6,
-  A_7,
-  A_8,
-  A_9,
-  A_0,
-
-  // Fx
-  Fx,
+  XF_1 = 0,
+  XF_2,
+  XF_3,
+  XF_4,
+  XF_5,
+  XF_6,
+  XF_7,
+  XF_8,
+  XF_9,
+  XF_0,
+  XF_HU_AA,
+  XF_HU_OO,
+  XF_HU_EE,
+  XF_HU_UU,
+  XF_HU_II,
+  XF_HU_OE,
+  XF_HU_UE,
+  XF_HU_OEE,
+  XF_HU_UEE,
+  XF_COUNT
 };
 
+/* Macros: the IDs, and the handler of each, are listed in macros.def */
+
+#include "macro-table.h"
+
 /* Fn keys */
 
 enum {
@@ -107,7 +105,7 @@ bool log_enable = false;
 # endif
 #endif
 
-bool time_travel = false;
+bool abbrev_enable = false;
 bool skip_leds = false;
 
 static uint8_t is_adore = 0;
@@ -444,6 +442,167 @@ const uint16_t PROGMEM fn_actions[] = {
   ,[F_CTRL] = ACTION_MODS_ONESHOT (MOD_LCTL)
 };
 
+/* Host commands
+ *
+ * The commands in commands.def are run by tools/hid-commands. With
+ * RAW_COMMANDS_ENABLE, they are sent as a raw HID report, carrying the
+ * opcode only; otherwise as a "CMD:<name>" line on the HID console.
+ */
+
+#ifdef RAW_COMMANDS_ENABLE
+// RAW_EPSIZE: raw_hid_send() only sends reports of exactly this size
+#define ANG_RAW_REPORT_SIZE 32
+#define ANG_RAW_COMMAND 0x01
+
+static void ang_command (uint8_t cmd) {
+  uint8_t report[ANG_RAW_REPORT_SIZE] = { ANG_RAW_COMMAND, cmd };
+
+  raw_hid_send (report, sizeof (report));
+}
+
+// The host does not send anything on the raw HID interface.
+void raw_hid_receive (uint8_t *data, uint8_t length) {
+}
+#else
+static void ang_command (uint8_t cmd) {
+  char name[CMD_NAME_SIZE];
+
+  strcpy_P (name, command_names[cmd]);
+  uprintf ("CMD:%s\n", name);
+}
+#endif
+
+/* Steno
+ *
+ * By default, the PLVR layer types like an NKRO keyboard, and Plover puts
+ * the strokes together from the key events. With STENO_PROTOCOL set to
+ * gemini or txbolt in rules.mk, the keys are collected into a chord
+ * instead, and when the last one is released, the stroke is sent to Plover
+ * in a single packet, on the virtual serial port.
+ */
+
+#if defined(STENO_GEMINI) || defined(STENO_TXBOLT)
+#define ANG_STENO
+
+#ifdef STENO_GEMINI
+// GeminiPR: six bytes of seven keys each, the first one has its top bit
+// set. The keys are numbered in the order they are sent.
+#define STENO_PACKET_SIZE 6
+#define STENO_KEY(n) (n) / 7, 0x40 >> ((n) % 7)
+
+enum {
+  SK_NUM = 1,
+  SK_LS = 7, SK_LT = 9, SK_LK, SK_LP, SK_LW, SK_LH, SK_LR, SK_A, SK_O, SK_STAR,
+  SK_E = 24, SK_U, SK_RF, SK_RR, SK_RP, SK_RB, SK_RL, SK_RG, SK_RT, SK_RS, SK_RD,
+  SK_RZ = 41,
+};
+#else
+// TX Bolt: one byte for each group of six keys that has any pressed, the
+// group number in the top two bits, and a zero byte ending the stroke.
+#define STENO_PACKET_SIZE 4
+#define STENO_KEY(n) (n) / 6, 1 << ((n) % 6)
+
+enum {
+  SK_LS = 0, SK_LT, SK_LK, SK_LP, SK_LW, SK_LH,
+  SK_LR, SK_A, SK_O, SK_STAR, SK_E, SK_U,
+  SK_RF, SK_RR, SK_RP, SK_RB, SK_RL, SK_RG,
+  SK_RT, SK_RS, SK_RD, SK_RZ, SK_NUM,
+};
+#endif
+
+typedef struct {
+  uint8_t keycode;
+  uint8_t byte;
+  uint8_t mask;
+} ang_steno_key_t;
+
+static const ang_steno_key_t PROGMEM steno_keys[] = {
+  { PV_NUM,  STENO_KEY (SK_NUM) },
+  { PV_LS,   STENO_KEY (SK_LS) },
+  { PV_LT,   STENO_KEY (SK_LT) },
+  { PV_LK,   STENO_KEY (SK_LK) },
+  { PV_LP,   STENO_KEY (SK_LP) },
+  { PV_LW,   STENO_KEY (SK_LW) },
+  { PV_LH,   STENO_KEY (SK_LH) },
+  { PV_LR,   STENO_KEY (SK_LR) },
+  { PV_A,    STENO_KEY (SK_A) },
+  { PV_O,    STENO_KEY (SK_O) },
+  { PV_STAR, STENO_KEY (SK_STAR) },
+  { PV_E,    STENO_KEY (SK_E) },
+  { PV_U,    STENO_KEY (SK_U) },
+  { PV_RF,   STENO_KEY (SK_RF) },
+  { PV_RR,   STENO_KEY (SK_RR) },
+  { PV_RP,   STENO_KEY (SK_RP) },
+  { PV_RB,   STENO_KEY (SK_RB) },
+  { PV_RL,   STENO_KEY (SK_RL) },
+  { PV_RG,   STENO_KEY (SK_RG) },
+  { PV_RT,   STENO_KEY (SK_RT) },
+  { PV_RS,   STENO_KEY (SK_RS) },
+  { PV_RD,   STENO_KEY (SK_RD) },
+  { PV_RZ,   STENO_KEY (SK_RZ) },
+};
+
+static uint8_t steno_chord[STENO_PACKET_SIZE];
+// The keys added to the chord, by matrix position, and how many of them
+// are still held down
+static uint8_t steno_down[MATRIX_ROWS];
+static uint8_t steno_held;
+
+// Adds the key to the chord, if it is a steno key.
+static bool ang_steno_add (uint16_t keycode) {
+  for (uint8_t i = 0; i < sizeof (steno_keys) / sizeof (steno_keys[0]); i++) {
+    const ang_steno_key_t *key = &steno_keys[i];
+
+    if (pgm_read_byte (&key->keycode) == keycode) {
+      steno_chord[pgm_read_byte (&key->byte)] |= pgm_read_byte (&key->mask);
+      return true;
+    }
+  }
+  return false;
+}
+
+static void ang_steno_send (void) {
+#ifdef STENO_GEMINI
+  steno_chord[0] |= 0x80;
+  for (uint8_t i = 0; i < STENO_PACKET_SIZE; i++)
+    virtser_send (steno_chord[i]);
+#else
+  for (uint8_t i = 0; i < STENO_PACKET_SIZE; i++)
+    if (steno_chord[i])
+      virtser_send (steno_chord[i] | (i << 6));
+  virtser_send (0);
+#endif
+  memset (steno_chord, 0, sizeof (steno_chord));
+}
+
+static bool ang_steno_process (uint16_t keycode, keyrecord_t *record) {
+  uint8_t row = record->event.key.row;
+  uint8_t bit = 1 << record->event.key.col;
+
+  if (!record->event.pressed) {
+    // Only the release of keys added to the chord on press
+    if (!(steno_down[row] & bit))
+      return true;
+    steno_down[row] &= ~bit;
+    // The stroke is complete when every key is up
+    if (!--steno_held)
+      ang_steno_send ();
+    return false;
+  }
+
+  if (keycode > 0xFF || !ang_steno_add (keycode))
+    return true;
+  steno_down[row] |= bit;
+  steno_held++;
+  return false;
+}
+#endif
+
+// The stroke that toggles Plover's output: PHROLG
+static const uint8_t PROGMEM steno_toggle[] = {
+  PV_LP, PV_LH, PV_LR, PV_O, PV_RL, PV_RG
+};
+
 static void toggle_steno(int pressed)
 {
   uint8_t layer = biton32(layer_state);
@@ -451,276 +610,407 @@ static void toggle_steno(int pressed)
   if (pressed) {
     if (layer != PLVR) layer_on(PLVR); else layer_off(PLVR);
 
-    register_code(PV_LP);
-    register_code(PV_LH);
-    register_code(PV_LR);
-    register_code(PV_O);
-    register_code(PV_RL);
-    register_code(PV_RG);
+#ifdef ANG_STENO
+    // Whatever was held when the layer changed will not finish a stroke
+    memset (steno_down, 0, sizeof (steno_down));
+    steno_held = 0;
+#endif
+    for (uint8_t i = 0; i < sizeof (steno_toggle); i++) {
+#ifdef ANG_STENO
+      ang_steno_add (pgm_read_byte (&steno_toggle[i]));
+#else
+      register_code (pgm_read_byte (&steno_toggle[i]));
+#endif
+    }
+#ifdef ANG_STENO
+    ang_steno_send ();
+#endif
   } else {
-    unregister_code(PV_LP);
-    unregister_code(PV_LH);
-    unregister_code(PV_LR);
-    unregister_code(PV_O);
-    unregister_code(PV_RL);
-    unregister_code(PV_RG);
+#ifndef ANG_STENO
+    for (uint8_t i = 0; i < sizeof (steno_toggle); i++)
+      unregister_code (pgm_read_byte (&steno_toggle[i]));
+#endif
   }
 }
 
-static macro_t *ang_do_hun (keyrecord_t *record, uint16_t accent, uint16_t hun_char)
-{
-  uint8_t need_shift = 0;
-  uint8_t hold_shift = 0;
-
-  if (!record->event.pressed)
-    return MACRO_NONE;
+/* Effective modifiers
+ *
+ * The modifiers held down, plus the one-shot ones that have not timed out
+ * yet. Computed once at the start of every key event, and every scan
+ * before the LEDs are updated, and again when the keymap changes the
+ * one-shot modifiers itself; the macros and the LEDs read these instead of
+ * checking the one-shot timeout each.
+ */
 
-  layer_off (HUN);
+static uint8_t mods_effective;
+static uint8_t mods_oneshot;
 
-  if (keyboard_report->mods & MOD_BIT (KC_LSFT)) {
-    hold_shift = 1;
-    need_shift = 1;
-    unregister_code (KC_LSFT);
-  }
-  if ((get_oneshot_mods () & MOD_BIT(KC_LSFT)) && !has_oneshot_mods_timed_out ()) {
-    need_shift = 1;
-    hold_shift = 0;
-    unregister_code (KC_LSFT);
-  }
+static void ang_mods_update (void) {
+  mods_oneshot = get_oneshot_mods ();
+  if (mods_oneshot && has_oneshot_mods_timed_out ())
+    mods_oneshot = 0;
+  mods_effective = keyboard_report->mods | mods_oneshot;
+}
 
+static void ang_mods_clear_oneshot (void) {
   clear_oneshot_mods ();
+  ang_mods_update ();
+}
 
-  register_code (KC_RALT);
-  unregister_code (KC_RALT);
-  if (accent == (KC_DQT)) {
-    register_code (KC_RSFT);
-  }
-  register_code (accent);
-  unregister_code (accent);
-  if (need_shift && accent != (KC_DQT)) {
-    register_code (KC_RSFT);
-  } else if (accent == (KC_DQT) && !need_shift) {
-    unregister_code (KC_RSFT);
+static bool ang_shifted (void) {
+  return mods_effective & MOD_BIT (KC_LSFT);
+}
+
+/* Hungarian accented characters
+ *
+ * Typed either with the compose key (RAlt, the default), or with unicode
+ * input when HUN_UNICODE_INPUT is defined, whichever the host handles
+ * better. Both paths build the HID reports by hand, sending only one report
+ * for every step: compose is four reports per character (compose, accent,
+ * letter, release), unicode input is five or six.
+ */
+
+#ifdef HUN_UNICODE_INPUT
+static void ang_hun_send_unicode (uint16_t code, uint8_t mods) {
+  uint8_t last = KC_U;
+  int8_t shift = 12;
+
+  set_mods (MOD_BIT (KC_LCTL) | MOD_BIT (KC_LSFT));
+  add_key (KC_U);
+  send_keyboard_report ();
+  set_mods (0);
+
+  while (shift > 0 && !((code >> shift) & 0xf))
+    shift -= 4;
+
+  for (; shift >= 0; shift -= 4) {
+    uint8_t digit = (code >> shift) & 0xf;
+    uint8_t kc = digit == 0 ? KC_0 : (digit < 0xa ? KC_1 + digit - 1 : KC_A + digit - 0xa);
+
+    del_key (last);
+    if (kc == last)
+      send_keyboard_report ();
+    add_key (kc);
+    send_keyboard_report ();
+    last = kc;
   }
-  register_code (hun_char);
-  unregister_code (hun_char);
-  if (need_shift || accent == (KC_DQT))
-    unregister_code (KC_RSFT);
-  if (hold_shift)
-    register_code (KC_LSFT);
 
-  return MACRO_NONE;
+  del_key (last);
+  add_key (KC_SPC);
+  send_keyboard_report ();
+
+  del_key (KC_SPC);
+  set_mods (mods);
+  send_keyboard_report ();
+}
+#else
+static void ang_hun_send_compose (uint16_t accent, uint8_t letter, bool shift, uint8_t mods) {
+  uint8_t accent_kc = accent & 0xff;
+
+  set_mods (MOD_BIT (KC_RALT));
+  send_keyboard_report ();
+
+  set_mods ((accent & QK_LSFT) ? MOD_BIT (KC_LSFT) : 0);
+  add_key (accent_kc);
+  send_keyboard_report ();
+
+  del_key (accent_kc);
+  set_mods (shift ? MOD_BIT (KC_LSFT) : 0);
+  add_key (letter);
+  send_keyboard_report ();
+
+  del_key (letter);
+  set_mods (mods);
+  send_keyboard_report ();
+}
+#endif
+
+/* Key transforms
+ *
+ * The number row and the Hungarian keys each type a key chosen by whether
+ * shift is held: one row of key_transforms[] for every key, named by the
+ * argument of its macro in macros.def. Number row keys register their key
+ * while held down, Hungarian ones type the accented character with compose
+ * (or unicode input) when pressed.
+ */
+
+// The accent is typed with shift
+#define XF_ACCENT_SHIFT 0x01
+
+typedef struct {
+  uint8_t  lower;       // typed without shift
+  uint8_t  upper;       // typed with shift (still held), or KC_NO
+  uint8_t  accent;      // the compose accent typed first, KC_NO for none
+  uint8_t  flags;
+#ifdef HUN_UNICODE_INPUT
+  uint16_t lower_code;  // the character to type with unicode input,
+  uint16_t upper_code;  // instead of compose
+#endif
+} ang_xform_t;
+
+#ifdef HUN_UNICODE_INPUT
+#define XF_UNICODE(lower, upper) , lower, upper
+#else
+#define XF_UNICODE(lower, upper)
+#endif
+
+#define XF_KEY(lower, upper) { lower, upper, KC_NO, 0 XF_UNICODE (0, 0) }
+#define XF_HUN(accent, letter, lower, upper)                            \
+  { letter, letter, (accent) & 0xff, ((accent) & QK_LSFT) ? XF_ACCENT_SHIFT : 0 \
+    XF_UNICODE (lower, upper) }
+
+static const ang_xform_t PROGMEM key_transforms[XF_COUNT] = {
+  // The number row: with shift, A_8 and A_9 type nothing
+  [XF_1]      = XF_KEY (KC_1, KC_6),                // 1 ^
+  [XF_2]      = XF_KEY (KC_2, KC_1),                // 2 !
+  [XF_3]      = XF_KEY (KC_3, KC_4),                // 3 $
+  [XF_4]      = XF_KEY (KC_4, KC_3),                // 4 #
+  [XF_5]      = XF_KEY (KC_5, KC_8),                // 5 *
+  [XF_6]      = XF_KEY (KC_6, KC_7),                // 6 &
+  [XF_7]      = XF_KEY (KC_7, KC_2),                // 7 @
+  [XF_8]      = XF_KEY (KC_8, KC_NO),               // 8
+  [XF_9]      = XF_KEY (KC_9, KC_NO),               // 9
+  [XF_0]      = XF_KEY (KC_0, KC_5),                // 0 %
+
+  // Hungarian
+  [XF_HU_AA]  = XF_HUN (KC_QUOT, KC_A, 0x00e1, 0x00c1), // Á
+  [XF_HU_OO]  = XF_HUN (KC_QUOT, KC_O, 0x00f3, 0x00d3), // Ó
+  [XF_HU_EE]  = XF_HUN (KC_QUOT, KC_E, 0x00e9, 0x00c9), // É
+  [XF_HU_UU]  = XF_HUN (KC_QUOT, KC_U, 0x00fa, 0x00da), // Ú
+  [XF_HU_II]  = XF_HUN (KC_QUOT, KC_I, 0x00ed, 0x00cd), // Í
+  [XF_HU_OE]  = XF_HUN (KC_DQT,  KC_O, 0x00f6, 0x00d6), // Ö
+  [XF_HU_UE]  = XF_HUN (KC_DQT,  KC_U, 0x00fc, 0x00dc), // Ü
+  [XF_HU_OEE] = XF_HUN (KC_EQL,  KC_O, 0x0151, 0x0150), // Ő
+  [XF_HU_UEE] = XF_HUN (KC_EQL,  KC_U, 0x0171, 0x0170), // Ű
+};
+
+// The key each transform registered, until it is released
+static uint8_t xform_held[XF_COUNT];
+
+static void ang_xform_hun (const ang_xform_t *xf) {
+  uint8_t mods = get_mods ();
+  bool shift = ang_shifted ();
+
+  layer_off (HUN);
+  ang_mods_clear_oneshot ();
+
+#ifdef HUN_UNICODE_INPUT
+  ang_hun_send_unicode (pgm_read_word (shift ? &xf->upper_code : &xf->lower_code), mods);
+#else
+  ang_hun_send_compose (pgm_read_byte (&xf->accent) |
+                        ((pgm_read_byte (&xf->flags) & XF_ACCENT_SHIFT) ? QK_LSFT : 0),
+                        pgm_read_byte (&xf->lower), shift, mods);
+#endif
 }
 
-static void ang_handle_num_row(uint8_t id, keyrecord_t *record) {
-  uint8_t idx = id - A_1;
+static void ang_xform (uint8_t idx, keyrecord_t *record) {
+  const ang_xform_t *xf;
   uint8_t kc;
-  static bool shifted[10];
 
-  if (keyboard_report->mods & MOD_BIT(KC_LSFT) ||
-      ((get_oneshot_mods() & MOD_BIT(KC_LSFT)) && !has_oneshot_mods_timed_out())) {
-    if (record->event.pressed)
-      shifted[idx] = true;
+  if (idx >= XF_COUNT)
+    return;
+
+  xf = &key_transforms[idx];
+
+  if (record->event.pressed) {
+    if (pgm_read_byte (&xf->accent)) {
+      ang_xform_hun (xf);
+      return;
+    }
+
+    kc = pgm_read_byte (ang_shifted () ? &xf->upper : &xf->lower);
+    if (kc == KC_NO)
+      return;
+    xform_held[idx] = kc;
+    register_code (kc);
+    return;
   }
 
-  if (!shifted[idx]) {
-    kc = idx + KC_1;
-  } else {
-    switch (id) {
-    case A_8:
-    case A_9:
-      shifted[idx] = false;
+  kc = xform_held[idx];
+  if (kc == KC_NO)
+    return;
+  xform_held[idx] = KC_NO;
+
+  // With keys rolled over, another one may still hold the same key down
+  for (uint8_t i = 0; i < XF_COUNT; i++)
+    if (xform_held[i] == kc)
       return;
+  unregister_code (kc);
+}
 
-    case A_7:
-      kc = KC_2;
-      break;
-    case A_5:
-      kc = KC_8;
-      break;
-    case A_3:
-      kc = KC_4;
-      break;
-    case A_1:
-      kc = KC_6;
-      break;
+/* Macro handlers, dispatched to through macro_table[] */
 
-    case A_0:
-      kc = KC_5;
-      break;
-    case A_2:
-      kc = KC_1;
-      break;
-    case A_4:
-      kc = KC_3;
-      break;
-    case A_6:
-      kc = KC_7;
-      break;
-    }
+static const macro_t *ang_macro_mpn (keyrecord_t *record, uint8_t arg) {
+  if (!record->event.pressed)
+    return MACRO_NONE;
+
+  if (ang_shifted ()) {
+    bool oneshot = mods_oneshot & MOD_BIT (KC_LSFT);
+
+    if (oneshot)
+      ang_mods_clear_oneshot ();
+    unregister_code (KC_LSFT);
+
+    register_code (KC_MPRV);
+    unregister_code (KC_MPRV);
+
+    if (!oneshot)
+      register_code (KC_LSFT);
+    return MACRO_NONE;
   }
 
+  return MACRO (T(MNXT), END);
+}
+
+static const macro_t *ang_macro_plover (keyrecord_t *record, uint8_t arg) {
+  toggle_steno (record->event.pressed);
+  return MACRO_NONE;
+}
+
+static const macro_t *ang_macro_fx (keyrecord_t *record, uint8_t arg) {
   if (record->event.pressed) {
-    register_code (kc);
+    set_oneshot_mods (MOD_LALT);
+    ang_mods_update ();
+    layer_on (NMDIA);
+    set_oneshot_layer (NMDIA, ONESHOT_START);
   } else {
-    unregister_code (kc);
-    shifted[idx] = false;
+    clear_oneshot_layer_state (ONESHOT_PRESSED);
   }
+  return MACRO_NONE;
 }
 
-const macro_t *action_get_macro(keyrecord_t *record, uint8_t id, uint8_t opt)
-{
-      switch(id) {
-      case A_MPN:
-        if (record->event.pressed) {
-          if (keyboard_report->mods & MOD_BIT(KC_LSFT) ||
-              ((get_oneshot_mods() & MOD_BIT(KC_LSFT)) && !has_oneshot_mods_timed_out())) {
-            int oneshot = ((get_oneshot_mods() & MOD_BIT(KC_LSFT)) && !has_oneshot_mods_timed_out());
-
-            if (oneshot)
-              clear_oneshot_mods ();
-            unregister_code (KC_LSFT);
-
-            register_code (KC_MPRV);
-            unregister_code (KC_MPRV);
-
-            if (!oneshot)
-              register_code (KC_LSFT);
-          } else {
-            return MACRO (T(MNXT), END);
-          }
-        }
-        break;
-
-        /* Hungarian layer */
-      case HU_AA:
-        return ang_do_hun (record, KC_QUOT, KC_A);
-      case HU_OO:
-        return ang_do_hun (record, KC_QUOT, KC_O);
-      case HU_EE:
-        return ang_do_hun (record, KC_QUOT, KC_E);
-      case HU_UU:
-        return ang_do_hun (record, KC_QUOT, KC_U);
-      case HU_II:
-        return ang_do_hun (record, KC_QUOT, KC_I);
-      case HU_OE:
-        return ang_do_hun (record, KC_DQT, KC_O);
-      case HU_UE:
-        return ang_do_hun (record, KC_DQT, KC_U);
-      case HU_OEE:
-        return ang_do_hun (record, KC_EQL, KC_O);
-      case HU_UEE:
-        return ang_do_hun (record, KC_EQL, KC_U);
-
-        /* Plover base */
-      case A_PLVR:
-        toggle_steno(record->event.pressed);
-        break;
-
-        /* Fx */
-      case Fx:
-        if (record->event.pressed) {
-          set_oneshot_mods (MOD_LALT);
-          layer_on (NMDIA);
-          set_oneshot_layer (NMDIA, ONESHOT_START);
-        } else {
-          clear_oneshot_layer_state (ONESHOT_PRESSED);
-        }
-        break;
-
-        /* GUI & AppSel */
-      case A_GUI:
-        if (record->event.pressed) {
-          register_code (KC_LGUI);
-          if (record->tap.count && !record->tap.interrupted) {
-            if (record->tap.count == 2) {
-              uprintf("CMD:appsel_start\n");
-              layer_on (APPSEL);
-              set_oneshot_layer (APPSEL, ONESHOT_START);
-            } else if (record->tap.count >= 3) {
-              uprintf("CMD:appsel_helper\n");
-              layer_off (APPSEL);
-              clear_oneshot_layer_state (ONESHOT_PRESSED);
-            }
-          } else {
-            record->tap.count = 0;
-          }
-          gui_timer = 0;
-        } else {
-          if (record->tap.count >= 2)
-            {
-              clear_oneshot_layer_state (ONESHOT_PRESSED);
-            }
-          gui_timer = timer_read ();
-        }
-        break;
-
-      case APP_SLK:
-        if (record->event.pressed)
-          uprintf("CMD:appsel_slack\n");
-        break;
-
-      case APP_EMCS:
-        if (record->event.pressed)
-          uprintf("CMD:appsel_emacs\n");
-        break;
-
-      case APP_TERM:
-        if (record->event.pressed)
-          uprintf("CMD:appsel_term\n");
-        break;
-
-      case APP_CHRM:
-        if (record->event.pressed)
-          uprintf("CMD:appsel_chrome\n");
-        break;
-
-      case APP_MSIC:
-        if (record->event.pressed)
-          uprintf("CMD:appsel_music\n");
-        break;
-
-      case APP_SOCL:
-        if (record->event.pressed)
-          uprintf("CMD:appsel_social\n");
-        break;
-
-      case APP_PMGR:
-        if (record->event.pressed)
-          uprintf("CMD:appsel_pwmgr\n");
-        break;
-
-      case APP_SCL2:
-        if (record->event.pressed)
-          uprintf("CMD:appsel_social2\n");
-        break;
-
-        // number row and symbols
-      case A_1 ... A_0:
-        ang_handle_num_row(id, record);
-        break;
+/* GUI & AppSel */
+static const macro_t *ang_macro_gui (keyrecord_t *record, uint8_t arg) {
+  if (record->event.pressed) {
+    register_code (KC_LGUI);
+    if (record->tap.count && !record->tap.interrupted) {
+      if (record->tap.count == 2) {
+        ang_command (CMD_APPSEL_START);
+        layer_on (APPSEL);
+        set_oneshot_layer (APPSEL, ONESHOT_START);
+      } else if (record->tap.count >= 3) {
+        ang_command (CMD_APPSEL_HELPER);
+        layer_off (APPSEL);
+        clear_oneshot_layer_state (ONESHOT_PRESSED);
+      }
+    } else {
+      record->tap.count = 0;
+    }
+    gui_timer = 0;
+  } else {
+    if (record->tap.count >= 2)
+      {
+        clear_oneshot_layer_state (ONESHOT_PRESSED);
       }
+    gui_timer = timer_read ();
+  }
+  return MACRO_NONE;
+}
+
+// Application select keys: the argument is the command to send.
+static const macro_t *ang_macro_command (keyrecord_t *record, uint8_t arg) {
+  if (record->event.pressed)
+    ang_command (arg);
+  return MACRO_NONE;
+}
+
+// The number row and the Hungarian keys: the argument indexes
+// key_transforms[].
+static const macro_t *ang_macro_xform (keyrecord_t *record, uint8_t arg) {
+  ang_xform (arg, record);
+  return MACRO_NONE;
+}
+
+static const macro_t *ang_action_get_macro (keyrecord_t *record, uint8_t id, uint8_t opt)
+{
+  ang_macro_fn_t fn;
 
-      return MACRO_NONE;
+  if (id >= MACRO_COUNT)
+    return MACRO_NONE;
+  fn = (ang_macro_fn_t) pgm_read_ptr (&macro_table[id].fn);
+  if (!fn)
+    return MACRO_NONE;
+  return fn (record, pgm_read_byte (&macro_table[id].arg));
+}
+
+/* Boot animation
+ *
+ * The LEDs fade from full brightness to dim, stay there for a second, then
+ * fade out. matrix_scan_user steps the animation, so keys work from the
+ * very first scan. Building with BOOT_ANIMATION_ENABLE=no leaves it out.
+ */
+
+#ifdef BOOT_ANIMATION_ENABLE
+enum {
+  BOOT_DONE = 0,
+  BOOT_DIM,
+  BOOT_HOLD,
+  BOOT_FADE,
 };
 
+static uint8_t boot_phase;
+static uint8_t boot_brightness;
+static uint16_t boot_timer;
+
+static void ang_boot_animation_start (void) {
+  ergodox_led_all_on ();
+  boot_brightness = LED_BRIGHTNESS_HI;
+  ergodox_led_all_set (boot_brightness);
+  boot_timer = timer_read ();
+  boot_phase = BOOT_DIM;
+}
+#endif
+
+// Returns true while the animation is running.
+static bool ang_boot_animation_step (void) {
+#ifdef BOOT_ANIMATION_ENABLE
+  switch (boot_phase) {
+  case BOOT_DIM:
+    if (timer_elapsed (boot_timer) < 5)
+      break;
+    boot_timer = timer_read ();
+    if (--boot_brightness > LED_BRIGHTNESS_LO)
+      ergodox_led_all_set (boot_brightness);
+    else
+      boot_phase = BOOT_HOLD;
+    break;
+
+  case BOOT_HOLD:
+    if (timer_elapsed (boot_timer) < 1000)
+      break;
+    boot_timer = timer_read ();
+    ergodox_led_all_set (boot_brightness);
+    boot_phase = BOOT_FADE;
+    break;
+
+  case BOOT_FADE:
+    if (timer_elapsed (boot_timer) < 10)
+      break;
+    boot_timer = timer_read ();
+    if (--boot_brightness > 0) {
+      ergodox_led_all_set (boot_brightness);
+    } else {
+      ergodox_led_all_off ();
+      boot_phase = BOOT_DONE;
+    }
+    break;
+  }
+
+  return boot_phase != BOOT_DONE;
+#else
+  return false;
+#endif
+}
+
 // Runs just one time when the keyboard initializes.
 void matrix_init_user(void) {
   uint8_t dl;
 
   set_unicode_input_mode(UC_LNX);
 
-  ergodox_led_all_on();
-  for (int i = LED_BRIGHTNESS_HI; i > LED_BRIGHTNESS_LO; i--) {
-    ergodox_led_all_set (i);
-    wait_ms (5);
-  }
-  wait_ms(1000);
-  for (int i = LED_BRIGHTNESS_LO; i > 0; i--) {
-    ergodox_led_all_set (i);
-    wait_ms (10);
-  }
-  ergodox_led_all_off();
+#ifdef BOOT_ANIMATION_ENABLE
+  ang_boot_animation_start ();
+#endif
 
   if (!eeconfig_is_enabled())
     eeconfig_init();
@@ -732,6 +1022,64 @@ void matrix_init_user(void) {
 
 LEADER_EXTERNS();
 
+/* Macro playback
+ *
+ * Taps queued by ang_tap() are played back from matrix_scan_user, one every
+ * ANG_TAP_DELAY milliseconds, so that scanning and key processing carry on
+ * while a long macro is being typed. Each queued keycode may carry
+ * modifiers (LSFT(KC_C), LCTL(LSFT(KC_U)), ...), those are held for the
+ * duration of the tap only. Taps marked with ANG_TAP_FAST are followed by
+ * the shorter UNICODE_TYPE_DELAY instead.
+ */
+
+#define ANG_TAP_FAST 0x8000
+
+static uint16_t tap_queue[ANG_TAP_QUEUE_SIZE];
+static uint8_t tap_queue_head;
+static uint8_t tap_queue_len;
+static uint16_t tap_queue_timer;
+static uint8_t tap_queue_delay;
+static bool tap_queue_waiting;
+
+static void ang_tap_queue_step (void) {
+  uint16_t kc;
+
+  if (tap_queue_waiting) {
+    if (timer_elapsed (tap_queue_timer) < tap_queue_delay)
+      return;
+    tap_queue_waiting = false;
+  }
+
+  if (!tap_queue_len)
+    return;
+
+  kc = tap_queue[tap_queue_head];
+  tap_queue_head = (tap_queue_head + 1) % ANG_TAP_QUEUE_SIZE;
+  tap_queue_len--;
+
+  tap_queue_delay = (kc & ANG_TAP_FAST) ? UNICODE_TYPE_DELAY : ANG_TAP_DELAY;
+  kc &= ~ANG_TAP_FAST;
+
+  register_code16 (kc);
+  unregister_code16 (kc);
+
+  tap_queue_timer = timer_read ();
+  tap_queue_waiting = true;
+}
+
+static void ang_tap_push (uint16_t kc) {
+  // A full queue makes room by typing its oldest tap right away, instead of
+  // dropping the new one: the UCIS fallback alone can queue more taps than
+  // fit.
+  if (tap_queue_len == ANG_TAP_QUEUE_SIZE) {
+    tap_queue_waiting = false;
+    ang_tap_queue_step ();
+  }
+
+  tap_queue[(tap_queue_head + tap_queue_len) % ANG_TAP_QUEUE_SIZE] = kc;
+  tap_queue_len++;
+}
+
 static void ang_tap (uint16_t code, ...) {
   uint16_t kc = code;
   va_list ap;
@@ -739,14 +1087,117 @@ static void ang_tap (uint16_t code, ...) {
   va_start(ap, code);
 
   do {
-    register_code16(kc);
-    unregister_code16(kc);
-    wait_ms(50);
+    ang_tap_push (kc);
     kc = va_arg(ap, int);
   } while (kc != 0);
   va_end(ap);
 }
 
+// Same as ang_tap(), for a zero-terminated list of keycodes in PROGMEM.
+static void ang_tap_P (const uint16_t *codes) {
+  uint16_t kc;
+
+  while ((kc = pgm_read_word (codes++)) != 0)
+    ang_tap_push (kc);
+}
+
+// Plays the rest of the queue right away, back to back, without the delays
+// between the taps: called when a key is pressed during playback, so that
+// it is typed after the macro, not in the middle, without stopping the
+// keyboard while the rest of the macro is typed.
+static void ang_tap_queue_flush (void) {
+  while (tap_queue_len) {
+    tap_queue_waiting = false;
+    ang_tap_queue_step ();
+  }
+  tap_queue_waiting = false;
+}
+
+/* LED state
+ *
+ * The state the LEDs should be in is derived from the layer and modifier
+ * state, and the LEDs are only written when that differs from what was
+ * written last. Code that drives the LEDs directly (animations, the reset
+ * tap dance) must call ang_leds_invalidate() when done, so the next scan
+ * writes everything again.
+ */
+
+typedef struct {
+  uint8_t on;
+  uint8_t brightness[3];
+} ang_led_state_t;
+
+static ang_led_state_t led_state;
+static bool led_state_valid;
+static uint32_t led_layer_state;
+static uint8_t led_mods;
+
+static void ang_leds_invalidate (void) {
+  led_state_valid = false;
+}
+
+static void ang_led_write (uint8_t led, bool on, uint8_t brightness, bool write_on, bool write_brightness) {
+  switch (led) {
+  case 0:
+    if (write_brightness) ergodox_right_led_1_set (brightness);
+    if (write_on) { if (on) ergodox_right_led_1_on (); else ergodox_right_led_1_off (); }
+    break;
+  case 1:
+    if (write_brightness) ergodox_right_led_2_set (brightness);
+    if (write_on) { if (on) ergodox_right_led_2_on (); else ergodox_right_led_2_off (); }
+    break;
+  case 2:
+    if (write_brightness) ergodox_right_led_3_set (brightness);
+    if (write_on) { if (on) ergodox_right_led_3_on (); else ergodox_right_led_3_off (); }
+    break;
+  }
+}
+
+static void ang_leds_update (void) {
+  ang_led_state_t s = { 0, { LED_BRIGHTNESS_LO, LED_BRIGHTNESS_LO, LED_BRIGHTNESS_LO } };
+  uint8_t mods = mods_effective;
+  uint8_t layer;
+  bool is_arrow;
+
+  if (skip_leds) {
+    led_state_valid = false;
+    return;
+  }
+
+  if (led_state_valid && layer_state == led_layer_state && mods == led_mods)
+    return;
+  led_layer_state = layer_state;
+  led_mods = mods;
+
+  layer = biton32 (layer_state);
+  is_arrow = layer_state & (1UL << ARRW);
+
+  if ((mods & MOD_BIT(KC_LSFT)) || layer == NMDIA || layer == PLVR || layer == ADORE || is_arrow)
+    s.on |= 1 << 0;
+  if ((mods & MOD_BIT(KC_LALT)) || layer == HUN || layer == NMDIA || layer == PLVR || layer == ADORE)
+    s.on |= 1 << 1;
+  if ((mods & MOD_BIT(KC_LCTRL)) || layer == HUN || layer == PLVR || layer == ADORE || is_arrow)
+    s.on |= 1 << 2;
+
+  if (mods & MOD_BIT(KC_LSFT))
+    s.brightness[0] = LED_BRIGHTNESS_HI;
+  if (mods & MOD_BIT(KC_LALT))
+    s.brightness[1] = LED_BRIGHTNESS_HI;
+  if (mods & MOD_BIT(KC_LCTRL))
+    s.brightness[2] = LED_BRIGHTNESS_HI;
+
+  for (uint8_t i = 0; i < 3; i++) {
+    bool on = s.on & (1 << i);
+
+    ang_led_write (i, on, s.brightness[i],
+                   !led_state_valid || on != (bool)(led_state.on & (1 << i)),
+                   !led_state_valid || s.brightness[i] != led_state.brightness[i]);
+  }
+
+  led_state = s;
+  led_state_valid = true;
+}
+
 #define TAP_ONCE(code)  \
   register_code (code); \
   unregister_code (code)
@@ -846,7 +1297,7 @@ _td_sr_finished (qk_tap_dance_state_t *state, void *user_data) {
     register_code (KC_MSTP);
   }
   if (state->count >= 4) {
-    uprintf("CMD:reflash\n");
+    ang_command (CMD_REFLASH);
     wait_ms (1000);
     reset_keyboard ();
     reset_tap_dance (state);
@@ -861,6 +1312,9 @@ _td_sr_reset (qk_tap_dance_state_t *state, void *user_data) {
   wait_ms (50);
   ergodox_right_led_3_off ();
 
+  skip_leds = false;
+  ang_leds_invalidate ();
+
   if (state->count == 1) {
     unregister_code (KC_MSTP);
   }
@@ -918,145 +1372,515 @@ qk_tap_dance_action_t tap_dance_actions[] = {
   ,[CT_SR]  = ACTION_TAP_DANCE_FN_ADVANCED (_td_sr_each, _td_sr_finished, _td_sr_reset)
 };
 
-// Runs constantly in the background, in a loop.
-void matrix_scan_user(void) {
-  uint8_t layer = biton32(layer_state);
-  bool is_arrow = false;
+#if defined(KEYLOGGER_ENABLE) || defined(LATENCY_STATS_ENABLE) || defined(PROFILE_ENABLE)
+static char *ang_hex (char *p, uint32_t v, uint8_t digits) {
+  static const char hex[] = "0123456789abcdef";
 
-  if (gui_timer && timer_elapsed (gui_timer) > TAPPING_TERM)
-    unregister_code (KC_LGUI);
+  while (digits--)
+    *p++ = hex[(v >> (digits * 4)) & 0xf];
+  return p;
+}
+#endif
 
-  if (!skip_leds) {
-    if (layer == HUN) {
-      ergodox_right_led_2_on();
-      ergodox_right_led_3_on();
-    } else if (layer == NMDIA) {
-      ergodox_right_led_1_on();
-      ergodox_right_led_2_on();
-    } else if (layer == PLVR) {
-      ergodox_right_led_1_on ();
-      ergodox_right_led_2_on ();
-      ergodox_right_led_3_on ();
-    } else if (layer == ADORE) {
-      ergodox_right_led_1_on ();
-      ergodox_right_led_2_on ();
-      ergodox_right_led_3_on ();
-
-      ergodox_right_led_2_set (LED_BRIGHTNESS_HI);
-    }
+#if defined(LATENCY_STATS_ENABLE) || defined(PROFILE_ENABLE)
+// TIMER_RAW ticks: 4us, or 64 cycles on the ErgoDox EZ. Wraps every 262ms.
+static uint16_t ang_ticks (void) {
+  uint16_t ms, raw;
+
+  // The tick counter wraps every millisecond; read it in the same one.
+  do {
+    ms = timer_read ();
+    raw = TIMER_RAW;
+  } while (ms != timer_read ());
+
+  return ms * TIMER_RAW_TOP + raw;
+}
+#endif
+
+#ifdef LATENCY_STATS_ENABLE
+/* Latency statistics
+ *
+ * The time from an event arriving in process_record_user() until the next
+ * matrix scan (or the next event, whichever comes first) - that is, all the
+ * keymap, tap dance, leader and macro code it runs, reports included - is
+ * counted in a histogram for the kind of key it was. Leader actions count
+ * as leader events too. Times are measured in TIMER_RAW ticks (4us on the
+ * ErgoDox EZ); bucket N counts times below 16 << N ticks, the last one
+ * everything longer.
+ *
+ * LEAD h prints the histograms on the HID console, and clears them:
+ *
+ *   LAT:<path>:<us per tick>:<count><count>...
+ *
+ * one line for each path, with the counts in four hex digits each.
+ */
+
+enum {
+  LAT_PLAIN = 0,
+  LAT_MACRO,
+  LAT_TAP_DANCE,
+  LAT_LEADER,
+  LAT_HUN,
+  LAT_PATHS
+};
+
+#define LAT_BUCKETS 12
+#define LAT_NONE 0xff
+
+static uint16_t lat_histogram[LAT_PATHS][LAT_BUCKETS];
+static uint16_t lat_start;
+static uint8_t lat_path = LAT_NONE;
+
+static void ang_lat_start (uint8_t path) {
+  lat_start = ang_ticks ();
+  lat_path = path;
+}
+
+static void ang_lat_end (void) {
+  uint16_t ticks;
+  uint8_t bucket = 0;
+
+  if (lat_path == LAT_NONE)
+    return;
+
+  ticks = (ang_ticks () - lat_start) >> 4;
+  while (ticks && bucket < LAT_BUCKETS - 1) {
+    ticks >>= 1;
+    bucket++;
   }
+  if (lat_histogram[lat_path][bucket] < 0xffff)
+    lat_histogram[lat_path][bucket]++;
+  lat_path = LAT_NONE;
+}
 
-  if (layer_state & (1UL << ARRW)) {
-    if (!skip_leds) {
-      ergodox_right_led_1_on ();
-      ergodox_right_led_3_on ();
-    }
-    is_arrow = true;
+static uint8_t ang_lat_path (uint16_t keycode) {
+  if (leading || keycode == KC_LEAD)
+    return LAT_LEADER;
+  if (keycode >= QK_TAP_DANCE && keycode <= QK_TAP_DANCE_MAX)
+    return LAT_TAP_DANCE;
+  if (keycode >= M(HU_AA) && keycode <= M(HU_UEE))
+    return LAT_HUN;
+  if (keycode >= QK_MACRO && keycode <= QK_MACRO_MAX)
+    return LAT_MACRO;
+  return LAT_PLAIN;
+}
+
+static void ang_lat_dump (void) {
+  char line[LAT_BUCKETS * 4 + 1];
+
+  for (uint8_t path = 0; path < LAT_PATHS; path++) {
+    char *p = line;
+
+    for (uint8_t bucket = 0; bucket < LAT_BUCKETS; bucket++)
+      p = ang_hex (p, lat_histogram[path][bucket], 4);
+    *p = 0;
+
+    uprintf ("LAT:%u:%u:%s\n", path, 1000 / TIMER_RAW_TOP, line);
   }
 
-  if (!skip_leds) {
-    if (keyboard_report->mods & MOD_BIT(KC_LSFT) ||
-        ((get_oneshot_mods() & MOD_BIT(KC_LSFT)) && !has_oneshot_mods_timed_out())) {
-      ergodox_right_led_1_set (LED_BRIGHTNESS_HI);
-      ergodox_right_led_1_on ();
-    } else {
-      ergodox_right_led_1_set (LED_BRIGHTNESS_LO);
-      if (layer != NMDIA && layer != PLVR && layer != ADORE && !is_arrow)
-        ergodox_right_led_1_off ();
-    }
+  memset (lat_histogram, 0, sizeof (lat_histogram));
+}
+#endif
 
-    if (keyboard_report->mods & MOD_BIT(KC_LALT) ||
-        ((get_oneshot_mods() & MOD_BIT(KC_LALT)) && !has_oneshot_mods_timed_out())) {
-      ergodox_right_led_2_set (LED_BRIGHTNESS_HI);
-      ergodox_right_led_2_on ();
-    } else {
-      ergodox_right_led_2_set (LED_BRIGHTNESS_LO);
-      if (layer != HUN && layer != NMDIA && layer != PLVR && layer != ADORE)
-        ergodox_right_led_2_off ();
-    }
+#ifdef PROFILE_ENABLE
+/* Profiler
+ *
+ * Counts the matrix scans in every second, and the calls of, and the ticks
+ * spent in matrix_scan_user(), process_record_user() and action_get_macro().
+ * A single call is often shorter than a tick, but as the calls start at
+ * random points within one, the sum of the rounded times is an unbiased
+ * estimate of the real total.
+ *
+ * LEAD p prints the counters on the HID console, and clears them:
+ *
+ *   PROF:<scans in the last second>:<us per tick>:<calls><ticks>...
+ *
+ * with the calls and the ticks in eight hex digits each, in the order
+ * above. Building with PROFILE_ENABLE=yes enables it.
+ */
 
-    if (keyboard_report->mods & MOD_BIT(KC_LCTRL) ||
-        ((get_oneshot_mods() & MOD_BIT(KC_LCTRL)) && !has_oneshot_mods_timed_out())) {
-      ergodox_right_led_3_set (LED_BRIGHTNESS_HI);
-      ergodox_right_led_3_on ();
-    } else {
-      ergodox_right_led_3_set (LED_BRIGHTNESS_LO);
-      if (layer != HUN && layer != PLVR && layer != ADORE && !is_arrow)
-        ergodox_right_led_3_off ();
+enum {
+  PROF_SCAN = 0,
+  PROF_RECORD,
+  PROF_MACRO,
+  PROF_FNS
+};
+
+typedef struct {
+  uint32_t calls;
+  uint32_t ticks;
+} ang_prof_t;
+
+static ang_prof_t prof[PROF_FNS];
+static uint16_t prof_timer;
+static uint16_t prof_scans;
+static uint16_t prof_scan_rate;
+
+static void ang_prof_add (uint8_t fn, uint16_t start) {
+  prof[fn].calls++;
+  prof[fn].ticks += (uint16_t)(ang_ticks () - start);
+}
+
+static void ang_prof_scan (void) {
+  prof_scans++;
+  if (timer_elapsed (prof_timer) >= 1000) {
+    prof_timer = timer_read ();
+    prof_scan_rate = prof_scans;
+    prof_scans = 0;
+  }
+}
+
+static void ang_prof_dump (void) {
+  char line[PROF_FNS * 16 + 1];
+  char *p = line;
+
+  for (uint8_t fn = 0; fn < PROF_FNS; fn++) {
+    p = ang_hex (p, prof[fn].calls, 8);
+    p = ang_hex (p, prof[fn].ticks, 8);
+  }
+  *p = 0;
+
+  uprintf ("PROF:%u:%u:%s\n", prof_scan_rate, 1000 / TIMER_RAW_TOP, line);
+
+  memset (prof, 0, sizeof (prof));
+}
+#endif
+
+#if KEYLOGGER_ENABLE
+/* Keylogger
+ *
+ * Every press and release is stored as a packed, six byte record in a RAM
+ * ring buffer, and the buffer is flushed to the HID console in batches, one
+ * line per batch:
+ *
+ *   KB:<dropped>:<record><record>...
+ *
+ * Both the count of dropped records and the records themselves are
+ * hex-encoded. A record is the key position and state
+ * (row << 4 | col << 1 | pressed), the active layer, and timer_read32(),
+ * in this order, big-endian. The drop counter counts records lost because
+ * the buffer was full, since power-up.
+ */
+
+typedef struct {
+  uint8_t pos;
+  uint8_t layer;
+  uint32_t time;
+} __attribute__((packed)) keylog_record_t;
+
+static keylog_record_t keylog_buffer[KEYLOG_BUFFER_SIZE];
+static uint8_t keylog_head;
+static uint8_t keylog_len;
+static uint16_t keylog_dropped;
+
+static void keylog_record (keyrecord_t *record) {
+  keylog_record_t *r;
+
+  if (keylog_len == KEYLOG_BUFFER_SIZE) {
+    keylog_dropped++;
+    return;
+  }
+
+  r = &keylog_buffer[(keylog_head + keylog_len) % KEYLOG_BUFFER_SIZE];
+  r->pos = (record->event.key.row << 4) | (record->event.key.col << 1) | record->event.pressed;
+  r->layer = biton32 (layer_state | default_layer_state);
+  r->time = timer_read32 ();
+  keylog_len++;
+}
+
+static void keylog_flush (void) {
+  char line[KEYLOG_BATCH_SIZE * sizeof (keylog_record_t) * 2 + 1];
+  char *p = line;
+  uint8_t n = 0;
+
+  if (!keylog_len)
+    return;
+  if (keylog_len < KEYLOG_BATCH_SIZE &&
+      timer_elapsed32 (keylog_buffer[keylog_head].time) < KEYLOG_FLUSH_TIMEOUT)
+    return;
+
+  while (keylog_len && n < KEYLOG_BATCH_SIZE) {
+    keylog_record_t *r = &keylog_buffer[keylog_head];
+
+    p = ang_hex (p, r->pos, 2);
+    p = ang_hex (p, r->layer, 2);
+    p = ang_hex (p, r->time, 8);
+
+    keylog_head = (keylog_head + 1) % KEYLOG_BUFFER_SIZE;
+    keylog_len--;
+    n++;
+  }
+  *p = 0;
+
+  uprintf ("KB:%04x:%s\n", keylog_dropped, line);
+}
+#endif
+
+#if SYMBOL_INPUT_ENABLE
+/* Unicode symbol input
+ *
+ * Started by LEAD u. The symbol name is typed as usual, while its keys walk
+ * the trie compiled from ucis.def, one node per key. Enter or Space erases
+ * the name, and types the symbol found at the last node - or, when there is
+ * none, the name itself as the code point. Escape only erases the name. All
+ * of it is typed through the tap queue.
+ */
+
+#define UCIS_TRIE_NOMATCH 0xffff
+
+static bool ucis_active;
+static uint8_t ucis_count;
+static uint8_t ucis_codes[UCIS_MAX_SYMBOL_LENGTH];
+static uint16_t ucis_nodes[UCIS_MAX_SYMBOL_LENGTH + 1];
+
+static void ang_tap_unicode_start (void) {
+  ang_tap_push (LCTL(LSFT(KC_U)) | ANG_TAP_FAST);
+}
+
+static void ang_tap_unicode_finish (void) {
+  ang_tap_push (KC_SPC | ANG_TAP_FAST);
+}
+
+static void ang_tap_unicode (uint32_t code) {
+  int8_t shift = 28;
+
+  while (shift > 12 && !((code >> shift) & 0xf))
+    shift -= 4;
+
+  ang_tap_unicode_start ();
+  for (; shift >= 0; shift -= 4) {
+    uint8_t digit = (code >> shift) & 0xf;
+
+    if (digit == 0)
+      ang_tap_push (KC_0 | ANG_TAP_FAST);
+    else if (digit < 0xa)
+      ang_tap_push ((KC_1 + digit - 1) | ANG_TAP_FAST);
+    else
+      ang_tap_push ((KC_A + digit - 0xa) | ANG_TAP_FAST);
+  }
+  ang_tap_unicode_finish ();
+}
+
+static uint16_t ang_ucis_trie_child (uint16_t node, uint8_t keycode) {
+  uint8_t first, keys;
+
+  if (node == UCIS_TRIE_NOMATCH)
+    return node;
+
+  first = pgm_read_byte (&ucis_trie_nodes[node].first_key);
+  keys = pgm_read_byte (&ucis_trie_nodes[node].keys);
+  if (keycode < first || keycode - first >= keys)
+    return UCIS_TRIE_NOMATCH;
+
+  node = pgm_read_word (&ucis_trie_edges[pgm_read_word (&ucis_trie_nodes[node].edges) +
+                                         keycode - first]);
+  return node == UCIS_TRIE_ROOT ? UCIS_TRIE_NOMATCH : node;
+}
+
+static void ang_ucis_start (void) {
+  ucis_active = true;
+  ucis_count = 0;
+  ucis_nodes[0] = UCIS_TRIE_ROOT;
+
+  /* ⌨ */
+  ang_tap_unicode (0x2328);
+}
+
+static void ang_ucis_finish (uint16_t keycode) {
+  uint16_t node = ucis_nodes[ucis_count];
+  uint16_t symbol = 0;
+
+  ucis_active = false;
+
+  // The name, and the marker in front of it.
+  for (uint8_t i = 0; i <= ucis_count; i++)
+    ang_tap_push (KC_BSPC | ANG_TAP_FAST);
+
+  if (keycode == KC_ESC)
+    return;
+
+  if (node != UCIS_TRIE_NOMATCH)
+    symbol = pgm_read_word (&ucis_trie_nodes[node].symbol);
+
+  if (symbol) {
+    ang_tap_unicode (pgm_read_dword (&ucis_symbol_codes[symbol - 1]));
+  } else {
+    ang_tap_unicode_start ();
+    for (uint8_t i = 0; i < ucis_count; i++)
+      ang_tap_push (ucis_codes[i] | ANG_TAP_FAST);
+    ang_tap_unicode_finish ();
+  }
+}
+
+static bool ang_ucis_process (uint16_t keycode, keyrecord_t *record) {
+  if (!record->event.pressed)
+    return true;
+
+  switch (keycode) {
+  case KC_BSPC:
+    if (!ucis_count)
+      return false;
+    ucis_count--;
+    return true;
+
+  case KC_ESC:
+  case KC_ENT:
+  case KC_SPC:
+    ang_ucis_finish (keycode);
+    return false;
+  }
+
+  if (keycode >= M(A_1) && keycode <= M(A_0))
+    keycode = keycode - M(A_1) + KC_1;
+
+  // Modifiers, layer keys and the like do not type anything.
+  if (!IS_KEY (keycode))
+    return true;
+
+  if (ucis_count >= UCIS_MAX_SYMBOL_LENGTH)
+    return false;
+
+  ucis_codes[ucis_count] = keycode;
+  ucis_nodes[ucis_count + 1] = ang_ucis_trie_child (ucis_nodes[ucis_count], keycode);
+  ucis_count++;
+  return true;
+}
+#endif
+
+/* Leader: the sequences are compiled into a trie from leader.def, and walked
+ * as the keys arrive, so the dictionary only has to look at the final node. */
+
+static uint8_t leader_node;
+static uint8_t leader_walked;
+
+#define LEADER_TRIE_NOMATCH 0xff
+
+void leader_start (void) {
+  leader_node = LEADER_TRIE_ROOT;
+  leader_walked = 0;
+}
+
+static void ang_leader_walk (void) {
+  while (leader_walked < leader_sequence_size) {
+    uint16_t keycode = leader_sequence[leader_walked++];
+    uint8_t first, keys;
+
+    if (leader_node == LEADER_TRIE_NOMATCH)
+      continue;
+
+    first = pgm_read_byte (&leader_trie_nodes[leader_node].first_key);
+    keys = pgm_read_byte (&leader_trie_nodes[leader_node].keys);
+    if (keycode < first || keycode - first >= keys) {
+      leader_node = LEADER_TRIE_NOMATCH;
+      continue;
     }
+
+    leader_node = pgm_read_byte (&leader_trie_edges[pgm_read_word (&leader_trie_nodes[leader_node].edges) +
+                                                    keycode - first]);
+    if (leader_node == LEADER_TRIE_ROOT)
+      leader_node = LEADER_TRIE_NOMATCH;
   }
+}
 
-  LEADER_DICTIONARY() {
+/* A sequence is complete when no longer one starts with it: there is no
+ * point in waiting for the timeout then. */
+static bool ang_leader_complete (void) {
+  ang_leader_walk ();
+  if (leader_node == LEADER_TRIE_NOMATCH)
+    return false;
+  return pgm_read_byte (&leader_trie_nodes[leader_node].keys) == 0;
+}
+
+static uint8_t ang_leader_action (void) {
+  ang_leader_walk ();
+  if (leader_node == LEADER_TRIE_NOMATCH)
+    return LEADER_NONE;
+  return pgm_read_byte (&leader_trie_nodes[leader_node].action);
+}
+
+static void ang_matrix_scan (void) {
+#ifdef LATENCY_STATS_ENABLE
+  ang_lat_end ();
+#endif
+
+  ang_tap_queue_step ();
+
+#if KEYLOGGER_ENABLE
+  keylog_flush ();
+#endif
+
+  if (gui_timer && timer_elapsed (gui_timer) > TAPPING_TERM) {
+    unregister_code (KC_LGUI);
+    gui_timer = 0;
+  }
+
+  ang_mods_update ();
+  if (!ang_boot_animation_step ())
+    ang_leds_update ();
+
+  if (leading && (ang_leader_complete () || timer_elapsed (leader_time) > LEADER_TIMEOUT)) {
     leading = false;
     leader_end ();
 
-    SEQ_ONE_KEY (KC_C) {
+#ifdef LATENCY_STATS_ENABLE
+    ang_lat_start (LAT_LEADER);
+#endif
+
+    switch (ang_leader_action ()) {
+    case LEADER_CSILLA:
       ang_tap (LSFT(KC_C), KC_S, KC_I, KC_L, KC_L, KC_RALT, KC_QUOT, KC_A, KC_M, KC_A, KC_S,
                KC_S, KC_Z, KC_O, KC_N, KC_Y, KC_K, KC_RALT, KC_QUOT, KC_A, KC_M, 0);
-    }
+      break;
 
-    SEQ_ONE_KEY (KC_K) {
-      ang_tap (KC_SPC, LSFT(KC_7), KC_SPC, 0);
-      register_code(KC_LCTL);
-      register_code(KC_LSFT);
-      register_code(KC_U);
-      unregister_code(KC_U);
-      unregister_code(KC_LSFT);
-      unregister_code(KC_LCTL);
-      ang_tap (KC_1, KC_F, KC_4, KC_7, KC_6, 0);
-      register_code (KC_ENT);
-      unregister_code (KC_ENT);
-      ang_tap (KC_END, 0);
-      register_code(KC_LCTL);
-      register_code(KC_LSFT);
-      register_code(KC_U);
-      unregister_code(KC_U);
-      unregister_code(KC_LSFT);
-      unregister_code(KC_LCTL);
-      ang_tap (KC_1, KC_F, KC_4, KC_7, KC_6, 0);
-      register_code (KC_SPC);
-      unregister_code (KC_SPC);
-    }
+    case LEADER_BABY:
+      ang_tap (KC_SPC, LSFT(KC_7), KC_SPC,
+               LCTL(LSFT(KC_U)), KC_1, KC_F, KC_4, KC_7, KC_6, KC_ENT,
+               KC_END,
+               LCTL(LSFT(KC_U)), KC_1, KC_F, KC_4, KC_7, KC_6, KC_SPC, 0);
+      break;
 
-    SEQ_ONE_KEY (KC_G) {
+    case LEADER_GEJGO:
       ang_tap (LSFT(KC_G), KC_E, KC_J, KC_G, KC_RALT, KC_EQL, KC_O,
                KC_RALT, KC_EQL, KC_O,
                KC_RALT, KC_EQL, KC_O, 0);
-    }
+      break;
 
 #if KEYLOGGER_ENABLE
-    SEQ_ONE_KEY (KC_D) {
+    case LEADER_KEYLOG:
       ergodox_led_all_on();
       wait_ms(100);
       ergodox_led_all_off();
+      ang_leds_invalidate ();
       log_enable = !log_enable;
-    }
+      break;
 #endif
 
-    SEQ_ONE_KEY (KC_T) {
-      time_travel = !time_travel;
-    }
+    case LEADER_ABBREV:
+      abbrev_enable = !abbrev_enable;
+      break;
 
-    SEQ_ONE_KEY (KC_U) {
-      qk_ucis_start();
-    }
+#if SYMBOL_INPUT_ENABLE
+    case LEADER_UCIS:
+      ang_ucis_start ();
+      break;
+#endif
 
-    SEQ_ONE_KEY (KC_V) {
+    case LEADER_VERSION:
       SEND_STRING (QMK_KEYBOARD "/" QMK_KEYMAP " @ (" QMK_VERSION "/" LAYOUT_ergodox_VERSION ")");
-    }
+      break;
 
-    SEQ_ONE_KEY (KC_L) {
+    case LEADER_LAMBDA:
       /* λ */
       unicode_input_start();
       register_hex(0x03bb);
       unicode_input_finish();
-    }
+      break;
 
-    SEQ_ONE_KEY (KC_Y) {
+    case LEADER_CHEER:
       ang_tap (KC_BSLS, KC_O, KC_SLSH, 0);
-    }
+      break;
 
-    SEQ_ONE_KEY (KC_S) {
+    case LEADER_SHRUG:
       unicode_input_start(); register_hex(0xaf); unicode_input_finish();
       TAP_ONCE (KC_BSLS);
       register_code (KC_RSFT); TAP_ONCE (KC_MINS); TAP_ONCE (KC_9); unregister_code (KC_RSFT);
@@ -1064,13 +1888,25 @@ void matrix_scan_user(void) {
       register_code (KC_RSFT); TAP_ONCE (KC_0); TAP_ONCE (KC_MINS); unregister_code (KC_RSFT);
       TAP_ONCE (KC_SLSH);
       unicode_input_start (); register_hex(0xaf); unicode_input_finish();
-    }
+      break;
 
-    SEQ_TWO_KEYS (KC_W, KC_M) {
-      uprintf("CMD:wm\n");
-    }
+    case LEADER_WM:
+      ang_command (CMD_WM);
+      break;
+
+#ifdef LATENCY_STATS_ENABLE
+    case LEADER_LATENCY:
+      ang_lat_dump ();
+      break;
+#endif
+
+#ifdef PROFILE_ENABLE
+    case LEADER_PROFILE:
+      ang_prof_dump ();
+      break;
+#endif
 
-    SEQ_ONE_KEY (KC_A) {
+    case LEADER_ADORE:
       if (is_adore == 0) {
         default_layer_and (0);
         default_layer_or ((1UL << ADORE));
@@ -1088,6 +1924,7 @@ void matrix_scan_user(void) {
         ergodox_right_led_2_off ();
         wait_ms (100);
         ergodox_right_led_1_off ();
+        ang_leds_invalidate ();
       } else {
         is_adore = 0;
         default_layer_and (0);
@@ -1105,46 +1942,69 @@ void matrix_scan_user(void) {
         ergodox_right_led_2_off ();
         wait_ms (100);
         ergodox_right_led_3_off ();
+        ang_leds_invalidate ();
       }
+      break;
     }
+
+#ifdef LATENCY_STATS_ENABLE
+    ang_lat_end ();
+#endif
   }
 }
 
-static uint16_t last4[4];
-
-const qk_ucis_symbol_t ucis_symbol_table[] = UCIS_TABLE
-(
- UCIS_SYM("poop", 0x1f4a9),
- UCIS_SYM("rofl", 0x1f923),
- UCIS_SYM("kiss", 0x1f619),
- UCIS_SYM("snowman", 0x2603),
- UCIS_SYM("coffee", 0x2615),
- UCIS_SYM("heart", 0x2764),
- UCIS_SYM("bolt", 0x26a1),
- UCIS_SYM("pi", 0x03c0),
- UCIS_SYM("mouse", 0x1f401),
- UCIS_SYM("micro", 0x00b5),
- UCIS_SYM("tm", 0x2122),
- UCIS_SYM("child", 0x1f476),
- UCIS_SYM("family", 0x1F46A)
-);
+/* Abbreviations: every released key moves the automaton compiled from
+ * abbrev.def one step, and when it arrives at a match, the expansion is
+ * queued for typing. */
 
-bool process_record_user (uint16_t keycode, keyrecord_t *record) {
-#if KEYLOGGER_ENABLE
-  if (log_enable) {
-    uint8_t layer = biton32(layer_state);
+static uint8_t abbrev_state;
+
+static void ang_abbrev_step (uint16_t keycode) {
+  uint8_t class = 0, match;
 
-    if ((layer == ADORE) || (layer == BASE))
-      uprintf ("KL: col=%02d, row=%02d, pressed=%d, layer=%s\n", record->event.key.col,
-               record->event.key.row, record->event.pressed, (is_adore) ? "ADORE" : "Dvorak");
+  if (keycode >= ABBREV_FIRST_KEY && keycode - ABBREV_FIRST_KEY < ABBREV_KEYS)
+    class = pgm_read_byte (&abbrev_classes[keycode - ABBREV_FIRST_KEY]);
+  abbrev_state = pgm_read_byte (&abbrev_next[abbrev_state][class]);
+
+  match = pgm_read_byte (&abbrev_match[abbrev_state]);
+  if (match) {
+    ang_tap_P ((const uint16_t *)pgm_read_ptr (&abbrev_expansions[match - 1]));
+    abbrev_state = 0;
   }
+}
+
+static bool ang_process_record (uint16_t keycode, keyrecord_t *record) {
+#ifdef LATENCY_STATS_ENABLE
+  ang_lat_end ();
+  ang_lat_start (ang_lat_path (keycode));
+#endif
+
+#if KEYLOGGER_ENABLE
+  if (log_enable)
+    keylog_record (record);
+#endif
+
+  ang_mods_update ();
+
+#ifdef ANG_STENO
+  if (biton32 (layer_state) == PLVR && !ang_steno_process (keycode, record))
+    return false;
+#endif
+
+  // Leader keys do not type anything, they can wait for the queue.
+  if (record->event.pressed && tap_queue_len && !leading && keycode != KC_LEAD)
+    ang_tap_queue_flush ();
+
+#if SYMBOL_INPUT_ENABLE
+  if (ucis_active)
+    return ang_ucis_process (keycode, record);
 #endif
 
   if (keycode == KC_ESC && record->event.pressed) {
     bool queue = true;
 
-    if ((get_oneshot_mods ()) && !has_oneshot_mods_timed_out ()) {
-      clear_oneshot_mods ();
+    if (mods_oneshot) {
+      ang_mods_clear_oneshot ();
       queue = false;
     }
     if (layer_state & (1UL<<HUN)) {
@@ -1154,41 +2014,47 @@ bool process_record_user (uint16_t keycode, keyrecord_t *record) {
     return queue;
   }
 
-  if (time_travel && !record->event.pressed) {
-    uint8_t p;
-
-    // shift cache one to the left
-    for (p = 0; p < 3; p++) {
-      last4[p] = last4[p + 1];
-    }
-    last4[3] = keycode;
+  if (abbrev_enable && !record->event.pressed)
+    ang_abbrev_step (keycode);
 
-    if (last4[0] == KC_D && last4[1] == KC_A && last4[2] == KC_T && last4[3] == KC_E) {
-      ang_tap (KC_E, KC_SPC, KC_MINS, KC_D, KC_SPC, KC_QUOT, 0);
-      register_code (KC_RSFT);
-      register_code (KC_EQL);
-      unregister_code (KC_EQL);
-      unregister_code (KC_RSFT);
+  return true;
+}
 
-      ang_tap (KC_4, KC_SPC, KC_D, KC_A, KC_Y, KC_S, KC_QUOT, 0);
+/* QMK entry points, timed by the profiler */
 
-      return false;
-    }
-  }
+const macro_t *action_get_macro (keyrecord_t *record, uint8_t id, uint8_t opt) {
+#ifdef PROFILE_ENABLE
+  uint16_t start = ang_ticks ();
+  const macro_t *macro = ang_action_get_macro (record, id, opt);
 
-  return true;
+  ang_prof_add (PROF_MACRO, start);
+  return macro;
+#else
+  return ang_action_get_macro (record, id, opt);
+#endif
 }
 
-void qk_ucis_symbol_fallback (void) {
-  for (uint8_t i = 0; i < qk_ucis_state.count - 1; i++) {
-    uint8_t code;
+// Runs constantly in the background, in a loop.
+void matrix_scan_user (void) {
+#ifdef PROFILE_ENABLE
+  uint16_t start = ang_ticks ();
+
+  ang_prof_scan ();
+  ang_matrix_scan ();
+  ang_prof_add (PROF_SCAN, start);
+#else
+  ang_matrix_scan ();
+#endif
+}
 
-    if ((qk_ucis_state.codes[i] >= M(A_1)) && (qk_ucis_state.codes[i] <= M(A_0)))
-      code = qk_ucis_state.codes[i] - M(A_1) + KC_1;
-    else
-      code = qk_ucis_state.codes[i];
-    register_code(code);
-    unregister_code(code);
-    wait_ms (10);
-  }
+bool process_record_user (uint16_t keycode, keyrecord_t *record) {
+#ifdef PROFILE_ENABLE
+  uint16_t start = ang_ticks ();
+  bool result = ang_process_record (keycode, record);
+
+  ang_prof_add (PROF_RECORD, start);
+  return result;
+#else
+  return ang_process_record (keycode, record);
+#endif
 }
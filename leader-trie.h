@@ -0,0 +1,54 @@
+/* Generated from leader.def by tools/leader-trie.py, do not edit! */
+
+#pragma once
+
+enum {
+  LEADER_NONE = 0,
+  LEADER_CSILLA,
+  LEADER_BABY,
+  LEADER_GEJGO,
+  LEADER_KEYLOG,
+  LEADER_ABBREV,
+  LEADER_UCIS,
+  LEADER_VERSION,
+  LEADER_LAMBDA,
+  LEADER_CHEER,
+  LEADER_SHRUG,
+  LEADER_WM,
+  LEADER_ADORE,
+  LEADER_LATENCY,
+  LEADER_PROFILE,
+};
+
+typedef struct {
+  uint8_t  action;
+  uint8_t  first_key;
+  uint8_t  keys;
+  uint16_t edges;
+} leader_trie_node_t;
+
+#define LEADER_TRIE_ROOT 0
+
+static const leader_trie_node_t PROGMEM leader_trie_nodes[] = {
+  { LEADER_NONE,         0x04, 25,    0 }, // start
+  { LEADER_ADORE,        0x00,  0,   25 }, // KC_A
+  { LEADER_CSILLA,       0x00,  0,   25 }, // KC_C
+  { LEADER_KEYLOG,       0x00,  0,   25 }, // KC_D
+  { LEADER_GEJGO,        0x00,  0,   25 }, // KC_G
+  { LEADER_LATENCY,      0x00,  0,   25 }, // KC_H
+  { LEADER_BABY,         0x00,  0,   25 }, // KC_K
+  { LEADER_LAMBDA,       0x00,  0,   25 }, // KC_L
+  { LEADER_PROFILE,      0x00,  0,   25 }, // KC_P
+  { LEADER_SHRUG,        0x00,  0,   25 }, // KC_S
+  { LEADER_ABBREV,       0x00,  0,   25 }, // KC_T
+  { LEADER_UCIS,         0x00,  0,   25 }, // KC_U
+  { LEADER_VERSION,      0x00,  0,   25 }, // KC_V
+  { LEADER_NONE,         0x10,  1,   25 }, // KC_W
+  { LEADER_CHEER,        0x00,  0,   26 }, // KC_Y
+  { LEADER_WM,           0x00,  0,   26 }, // KC_W KC_M
+};
+
+static const uint8_t PROGMEM leader_trie_edges[] = {
+   1,  0,  2,  3,  0,  0,  4,  5,  0,  0,  6,  7,  0,  0,  0,  8,
+   0,  0,  9, 10, 11, 12, 13,  0, 14, 15,
+};
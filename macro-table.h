@@ -0,0 +1,87 @@
+/* Generated from macros.def by tools/macro-table.py, do not edit! */
+
+#pragma once
+
+enum {
+  NONE = 0,
+  A_GUI,
+  A_PLVR,
+  A_MPN,
+  APP_SLK,
+  APP_EMCS,
+  APP_TERM,
+  APP_CHRM,
+  APP_MSIC,
+  APP_SOCL,
+  APP_PMGR,
+  APP_SCL2,
+  A_1,
+  A_2,
+  A_3,
+  A_4,
+  A_5,
+  A_6,
+  A_7,
+  A_8,
+  A_9,
+  A_0,
+  HU_AA,
+  HU_OO,
+  HU_EE,
+  HU_UU,
+  HU_II,
+  HU_OE,
+  HU_UE,
+  HU_OEE,
+  HU_UEE,
+  Fx,
+  MACRO_COUNT
+};
+
+typedef const macro_t *(*ang_macro_fn_t) (keyrecord_t *record, uint8_t arg);
+
+typedef struct {
+  ang_macro_fn_t fn;
+  uint8_t        arg;
+} ang_macro_t;
+
+static const macro_t *ang_macro_gui (keyrecord_t *record, uint8_t arg);
+static const macro_t *ang_macro_plover (keyrecord_t *record, uint8_t arg);
+static const macro_t *ang_macro_mpn (keyrecord_t *record, uint8_t arg);
+static const macro_t *ang_macro_command (keyrecord_t *record, uint8_t arg);
+static const macro_t *ang_macro_xform (keyrecord_t *record, uint8_t arg);
+static const macro_t *ang_macro_fx (keyrecord_t *record, uint8_t arg);
+
+static const ang_macro_t PROGMEM macro_table[MACRO_COUNT] = {
+  [A_GUI]    = { ang_macro_gui, 0 },
+  [A_PLVR]   = { ang_macro_plover, 0 },
+  [A_MPN]    = { ang_macro_mpn, 0 },
+  [APP_SLK]  = { ang_macro_command, CMD_APPSEL_SLACK },
+  [APP_EMCS] = { ang_macro_command, CMD_APPSEL_EMACS },
+  [APP_TERM] = { ang_macro_command, CMD_APPSEL_TERM },
+  [APP_CHRM] = { ang_macro_command, CMD_APPSEL_CHROME },
+  [APP_MSIC] = { ang_macro_command, CMD_APPSEL_MUSIC },
+  [APP_SOCL] = { ang_macro_command, CMD_APPSEL_SOCIAL },
+  [APP_PMGR] = { ang_macro_command, CMD_APPSEL_PWMGR },
+  [APP_SCL2] = { ang_macro_command, CMD_APPSEL_SOCIAL2 },
+  [A_1]      = { ang_macro_xform, XF_1 },
+  [A_2]      = { ang_macro_xform, XF_2 },
+  [A_3]      = { ang_macro_xform, XF_3 },
+  [A_4]      = { ang_macro_xform, XF_4 },
+  [A_5]      = { ang_macro_xform, XF_5 },
+  [A_6]      = { ang_macro_xform, XF_6 },
+  [A_7]      = { ang_macro_xform, XF_7 },
+  [A_8]      = { ang_macro_xform, XF_8 },
+  [A_9]      = { ang_macro_xform, XF_9 },
+  [A_0]      = { ang_macro_xform, XF_0 },
+  [HU_AA]    = { ang_macro_xform, XF_HU_AA },
+  [HU_OO]    = { ang_macro_xform, XF_HU_OO },
+  [HU_EE]    = { ang_macro_xform, XF_HU_EE },
+  [HU_UU]    = { ang_macro_xform, XF_HU_UU },
+  [HU_II]    = { ang_macro_xform, XF_HU_II },
+  [HU_OE]    = { ang_macro_xform, XF_HU_OE },
+  [HU_UE]    = { ang_macro_xform, XF_HU_UE },
+  [HU_OEE]   = { ang_macro_xform, XF_HU_OEE },
+  [HU_UEE]   = { ang_macro_xform, XF_HU_UEE },
+  [Fx]       = { ang_macro_fx, 0 },
+};
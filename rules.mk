@@ -6,10 +6,18 @@ DEBUG_ENABLE = no
 CONSOLE_ENABLE = no
 TAP_DANCE_ENABLE = yes
 KEYLOGGER_ENABLE ?= yes
-UCIS_ENABLE = yes
+UCIS_ENABLE = no
+UNICODE_ENABLE = yes
 MOUSEKEY_ENABLE = no
 
 AUTOLOG_ENABLE ?= no
+BOOT_ANIMATION_ENABLE ?= yes
+SYMBOL_INPUT_ENABLE ?= yes
+RAW_COMMANDS_ENABLE ?= no
+LATENCY_STATS_ENABLE ?= no
+PROFILE_ENABLE ?= no
+# How the PLVR layer talks to Plover: nkro, gemini or txbolt
+STENO_PROTOCOL ?= nkro
 
 ifeq (${FORCE_NKRO},yes)
 OPT_DEFS += -DFORCE_NKRO
@@ -25,8 +33,57 @@ OPT_DEFS += -DKEYLOGGER_ENABLE
 CONSOLE_ENABLE = yes
 endif
 
+ifeq (${RAW_COMMANDS_ENABLE},yes)
+RAW_ENABLE = yes
+OPT_DEFS += -DRAW_COMMANDS_ENABLE
+endif
+
+ifeq (${LATENCY_STATS_ENABLE},yes)
+OPT_DEFS += -DLATENCY_STATS_ENABLE
+endif
+
+ifeq (${PROFILE_ENABLE},yes)
+OPT_DEFS += -DPROFILE_ENABLE
+endif
+
+ifeq (${STENO_PROTOCOL},gemini)
+VIRTSER_ENABLE = yes
+OPT_DEFS += -DSTENO_GEMINI
+endif
+
+ifeq (${STENO_PROTOCOL},txbolt)
+VIRTSER_ENABLE = yes
+OPT_DEFS += -DSTENO_TXBOLT
+endif
+
+ifeq (${BOOT_ANIMATION_ENABLE},yes)
+OPT_DEFS += -DBOOT_ANIMATION_ENABLE
+endif
+
+ifeq (${SYMBOL_INPUT_ENABLE},yes)
+OPT_DEFS += -DSYMBOL_INPUT_ENABLE
+endif
+
 OPT_DEFS += -DUSER_PRINT
 
+# The leader sequences, the abbreviations, the Unicode symbols, the host
+# commands and the macros are compiled into lookup tables by make -C tools.
+# The generated headers are kept in the repository, for building without
+# Python; when it is available, the build checks that they are up to date,
+# and fails if one is not, without writing any of them.
+LAYOUT_ergodox_SRC := $(dir $(lastword $(MAKEFILE_LIST)))
+ifneq ($(shell command -v python3 2>/dev/null),)
+LAYOUT_ergodox_TABLES_ERROR := $(shell cd $(LAYOUT_ergodox_SRC) && \
+ python3 tools/leader-trie.py --check leader.def leader-trie.h 2>&1 && \
+ python3 tools/abbrev-automaton.py --check abbrev.def abbrev-automaton.h 2>&1 && \
+ python3 tools/ucis-trie.py --check ucis.def ucis-trie.h 2>&1 && \
+ python3 tools/commands-table.py --check commands.def commands-table.h 2>&1 && \
+ python3 tools/macro-table.py --check macros.def macro-table.h 2>&1)
+ifneq ($(LAYOUT_ergodox_TABLES_ERROR),)
+$(error $(LAYOUT_ergodox_TABLES_ERROR))
+endif
+endif
+
 LAYOUT_ergodox_VERSION = $(shell \
  if [ -d "${LAYOUT_ergodox_PATH}/.git" ]; then \
   cd "${LAYOUT_ergodox_PATH}" && git describe --abbrev=6 --dirty --always --tags --match 'v*' 2>/dev/null; \
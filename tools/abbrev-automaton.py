@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+#
+# Compiles the abbreviation table (abbrev.def) into an Aho-Corasick
+# automaton, stored in PROGMEM, that keymap.c feeds every released key to.
+#
+# The failure links are resolved here, so the automaton is a plain state
+# transition table: keycodes are mapped to a small set of classes (one for
+# each key used by any trigger, and one for everything else), and every
+# state has a next state for every class. Each key costs two table lookups,
+# however many abbreviations there are.
+#
+# Usage: abbrev-automaton.py [--check] abbrev.def abbrev-automaton.h
+#
+# The output is only rewritten when it changes. With --check, it is not
+# written at all, and the tool fails if it is out of date: the build runs
+# it that way.
+
+import os
+import sys
+
+from keymap_tables import fail, generator_args, keycodes, number_rows, update
+
+TAP_QUEUE_SIZE = 64
+
+
+class State(object):
+    def __init__(self, prefix):
+        self.prefix = prefix
+        self.children = {}
+        self.fail = None
+        self.match = None
+        self.index = None
+        self.next = None
+
+
+def parse(fn):
+    root = State([])
+    abbrevs = []
+
+    with open(fn) as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.split("#", 1)[0]
+            if not line.strip():
+                continue
+            if "=" not in line:
+                fail(fn, lineno, "missing \"=\"")
+            trigger, expansion = [part.split() for part in line.split("=", 1)]
+            if not trigger or not expansion:
+                fail(fn, lineno, "empty trigger or expansion")
+            if len(expansion) > TAP_QUEUE_SIZE:
+                fail(fn, lineno, "expansion is longer than %d keys" % TAP_QUEUE_SIZE)
+
+            state = root
+            for key in trigger:
+                if key not in keycodes:
+                    fail(fn, lineno, "unknown keycode %s" % key)
+                code = keycodes[key]
+                if code not in state.children:
+                    state.children[code] = State(state.prefix + [key])
+                state = state.children[code]
+            if state.match is not None:
+                fail(fn, lineno, "duplicate trigger %s" % " ".join(trigger))
+            state.match = len(abbrevs)
+            abbrevs.append((trigger, expansion))
+
+    return root, abbrevs
+
+
+def compile_automaton(root):
+    states = [root]
+    for state in states:
+        for code in sorted(state.children):
+            states.append(state.children[code])
+    for i, state in enumerate(states):
+        state.index = i
+
+    codes = sorted(set(code for state in states for code in state.children))
+    classes = dict((code, i + 1) for i, code in enumerate(codes))
+
+    # Breadth first, so the failure state is always resolved already.
+    for state in states:
+        state.next = [root] * (len(codes) + 1)
+        if state is root:
+            for code, child in state.children.items():
+                child.fail = root
+        else:
+            state.next = list(state.fail.next)
+            if state.match is None:
+                state.match = state.fail.match
+            for code, child in state.children.items():
+                child.fail = state.fail.next[classes[code]]
+        for code, child in state.children.items():
+            state.next[classes[code]] = child
+
+    return states, codes, classes
+
+
+def generate(root, abbrevs, source):
+    states, codes, classes = compile_automaton(root)
+    if len(states) > 255:
+        sys.stderr.write("%s: too many automaton states (%d)\n" % (source, len(states)))
+        sys.exit(1)
+
+    first = codes[0] if codes else 0
+    span = codes[-1] - first + 1 if codes else 0
+
+    out = []
+    out.append("/* Generated from %s by tools/abbrev-automaton.py, do not edit! */" % source)
+    out.append("")
+    out.append("#pragma once")
+    out.append("")
+    out.append("#define ABBREV_FIRST_KEY 0x%02x" % first)
+    out.append("#define ABBREV_KEYS %d" % span)
+    out.append("#define ABBREV_CLASSES %d" % (len(codes) + 1))
+    out.append("")
+
+    out.append("static const uint8_t PROGMEM abbrev_classes[] = {")
+    out.extend(number_rows([classes.get(code, 0) for code in range(first, first + span)]))
+    out.append("};")
+    out.append("")
+
+    out.append("static const uint8_t PROGMEM abbrev_next[][ABBREV_CLASSES] = {")
+    for state in states:
+        out.append("  { %s }, // %s" % (", ".join("%2d" % s.index for s in state.next),
+                                         " ".join(state.prefix) or "start"))
+    out.append("};")
+    out.append("")
+
+    out.append("/* The abbreviation matched in each state, plus one; 0 if none. */")
+    out.append("static const uint8_t PROGMEM abbrev_match[] = {")
+    out.extend(number_rows([0 if s.match is None else s.match + 1 for s in states]))
+    out.append("};")
+    out.append("")
+
+    for i, (trigger, expansion) in enumerate(abbrevs):
+        out.append("static const uint16_t PROGMEM abbrev_expansion_%d[] = {" % i)
+        out.append("  " + ", ".join(expansion + ["0"]))
+        out.append("};")
+        out.append("")
+
+    out.append("static const uint16_t * const PROGMEM abbrev_expansions[] = {")
+    for i in range(len(abbrevs)):
+        out.append("  abbrev_expansion_%d," % i)
+    if not abbrevs:
+        out.append("  NULL,")
+    out.append("};")
+    out.append("")
+
+    return "\n".join(out)
+
+
+def main():
+    (source, target, check) = generator_args("abbrev.def", "abbrev-automaton.h")
+
+    root, abbrevs = parse(source)
+    update(target, generate(root, abbrevs, os.path.basename(source)), check)
+
+if __name__ == "__main__":
+    main()
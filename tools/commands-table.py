@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+#
+# Compiles the host command table (commands.def) into an enum of opcodes,
+# and a PROGMEM table of their names, indexed by opcode, for the keyboards
+# that talk to tools/hid-commands on the HID console.
+#
+# Usage: commands-table.py [--check] commands.def commands-table.h
+#
+# The output is only rewritten when it changes. With --check, it is not
+# written at all, and the tool fails if it is out of date: the build runs
+# it that way.
+
+import os
+
+from keymap_tables import generator_args, parse_commands, update
+
+
+def generate(commands, source):
+    size = max(len(name) for (_, name) in commands) + 1
+
+    out = []
+    out.append("/* Generated from %s by tools/commands-table.py, do not edit! */" % source)
+    out.append("")
+    out.append("#pragma once")
+    out.append("")
+    out.append("enum {")
+    out.append("  CMD_NONE = 0,")
+    for (opcode, name) in commands:
+        out.append("  CMD_%s = 0x%02x," % (name.upper(), opcode))
+    out.append("};")
+    out.append("")
+    out.append("#define CMD_NAME_SIZE %d" % size)
+    out.append("")
+    out.append("static const char PROGMEM command_names[][CMD_NAME_SIZE] = {")
+    for (opcode, name) in commands:
+        out.append("  [CMD_%s] = \"%s\"," % (name.upper(), name))
+    out.append("};")
+    out.append("")
+    return "\n".join(out)
+
+
+def main():
+    (source, target, check) = generator_args("commands.def", "commands-table.h")
+
+    commands = parse_commands(source)
+    update(target, generate(commands, os.path.basename(source)), check)
+
+
+if __name__ == "__main__":
+    main()
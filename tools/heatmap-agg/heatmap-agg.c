@@ -0,0 +1,1210 @@
+/*
+ * heatmap-agg: aggregate keylogger output into heatmaps, fast.
+ *
+ * Reads the same input as log-to-heatmap.py - "KL:" lines, optionally
+ * timestamped as in its stamped-log, and "KB:" batches - with a streaming
+ * parser, counting presses and releases in a fixed 6x14 array per layer.
+ * At the end, it writes <outdir>/<layer>.json, the same heatmap that
+ * log-to-heatmap.py would, and prints Heatmap.get_stats() of every layer as
+ * JSON.
+ *
+ * Records carry the layer by number, named after the layer enum of keymap.c,
+ * which is read the same way log-to-heatmap.py reads it. Only layers with a
+ * heatmap layout get a heatmap: keys pressed on the others are skipped, with
+ * a warning.
+ *
+ * With --analytics, it also follows the order of key presses, and writes
+ * bigram and trigram frequencies, same-finger bigrams, hand alternation and
+ * inter-key intervals into a separate JSON file. These are counted in fixed
+ * size tables too, so memory use does not grow with the size of the log.
+ */
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ROWS 6
+#define COLS 14
+
+/* Layers */
+
+typedef struct {
+  char     *name;
+  int       layout;     // 1 if it has a heatmap layout, -1 if not, 0 if unknown
+  uint64_t  log[ROWS][COLS];
+  uint64_t  total;
+  uint64_t  max_cnt;
+} layer_t;
+
+static layer_t *layers;
+static size_t layer_count;
+static bool allowed[ROWS][COLS];
+static unsigned dropped_records;
+static const char *layouts_dir;
+
+// The names the keylogger output uses for the keymap.c layers, where they
+// differ: the base layer is named after the host layout it is typed with.
+static const char *log_layer_names[][2] = { { "BASE", "Dvorak" } };
+
+static char **layer_names;
+static size_t layer_name_count;
+
+static const uint8_t finger_map[COLS] = { 0, 0, 1, 2, 3, 3, 3, 1, 1, 1, 2, 3, 4, 4 };
+
+// The hand (0 for left, 1 for right) and finger the key at (c, r) is typed
+// with. Fingers are numbered as in finger_map: from the outside in on the
+// left hand, and from the inside out on the right.
+static void key_finger (unsigned c, unsigned r, unsigned *hand, unsigned *finger) {
+  if (r == 5 || (r == 4 && (c == 4 || c == 9))) {
+    // thumb cluster
+    *hand = c > 6;
+    *finger = *hand ? 0 : 4;
+  } else {
+    *hand = c >= 7;
+    *finger = finger_map[c];
+  }
+}
+
+static layer_t *layer_get (const char *name, size_t len) {
+  static layer_t *last;
+
+  if (last && strlen (last->name) == len && !memcmp (last->name, name, len))
+    return last;
+
+  for (size_t i = 0; i < layer_count; i++) {
+    if (strlen (layers[i].name) == len && !memcmp (layers[i].name, name, len)) {
+      last = &layers[i];
+      return last;
+    }
+  }
+
+  layers = realloc (layers, (layer_count + 1) * sizeof (layer_t));
+  if (!layers) {
+    perror ("realloc");
+    exit (1);
+  }
+  last = &layers[layer_count++];
+  memset (last, 0, sizeof (layer_t));
+  last->name = strndup (name, len);
+  return last;
+}
+
+static bool layer_has_layout (layer_t *layer) {
+  char fn[4096];
+
+  if (!layer->layout) {
+    snprintf (fn, sizeof (fn), "%s/heatmap-layout.%s.json", layouts_dir, layer->name);
+    layer->layout = access (fn, F_OK) ? -1 : 1;
+    if (layer->layout < 0)
+      fprintf (stderr, "No heatmap layout for layer %s, skipping its keys\n", layer->name);
+  }
+  return layer->layout > 0;
+}
+
+static const char *skip_space (const char *p) {
+  for (;;) {
+    if (isspace ((unsigned char)*p)) {
+      p++;
+    } else if (p[0] == '/' && p[1] == '/') {
+      p += strcspn (p, "\n");
+    } else if (p[0] == '/' && p[1] == '*') {
+      const char *e = strstr (p + 2, "*/");
+
+      p = e ? e + 2 : p + strlen (p);
+    } else {
+      return p;
+    }
+  }
+}
+
+static size_t ident_len (const char *p) {
+  size_t n = 0;
+
+  while (isalnum ((unsigned char)p[n]) || p[n] == '_')
+    n++;
+  return n;
+}
+
+static void add_layer_name (const char *name, size_t len) {
+  char *s = strndup (name, len);
+
+  for (size_t i = 0; i < sizeof (log_layer_names) / sizeof (log_layer_names[0]); i++) {
+    if (!strcmp (s, log_layer_names[i][0])) {
+      free (s);
+      s = strdup (log_layer_names[i][1]);
+    }
+  }
+
+  layer_names = realloc (layer_names, (layer_name_count + 1) * sizeof (char *));
+  if (!layer_names || !s) {
+    perror ("realloc");
+    exit (1);
+  }
+  layer_names[layer_name_count++] = s;
+}
+
+// The names of the layers, by number: the enum of keymap.c that starts with
+// BASE.
+static int read_layer_names (const char *fn) {
+  FILE *f = fopen (fn, "r");
+  char *text = NULL;
+  size_t size = 0;
+  const char *p;
+
+  if (!f || getdelim (&text, &size, 0, f) < 0) {
+    perror (fn);
+    if (f)
+      fclose (f);
+    return -1;
+  }
+  fclose (f);
+
+  for (p = text; (p = strstr (p, "enum")); p += 4) {
+    const char *q = skip_space (p + 4);
+    size_t n;
+
+    if ((p > text && (isalnum ((unsigned char)p[-1]) || p[-1] == '_')) || *q != '{')
+      continue;
+    q = skip_space (q + 1);
+    if (ident_len (q) != 4 || memcmp (q, "BASE", 4))
+      continue;
+
+    while ((n = ident_len (q))) {
+      add_layer_name (q, n);
+      q = skip_space (q + n);
+      if (*q == '=')
+        q += strcspn (q, ",}");
+      if (*q != ',')
+        break;
+      q = skip_space (q + 1);
+    }
+    free (text);
+    return 0;
+  }
+
+  fprintf (stderr, "%s: no layer enum found\n", fn);
+  free (text);
+  return -1;
+}
+
+/* Analytics */
+
+#define KEYS (ROWS * COLS)
+#define NGRAM_TOP 20
+#define INTERVAL_BUCKET_MS 10
+#define INTERVAL_BUCKETS 100
+
+enum { BIGRAM_ALTERNATING, BIGRAM_SAME_HAND, BIGRAM_SAME_FINGER, BIGRAM_SAME_KEY, BIGRAM_KINDS };
+
+static const char *bigram_kinds[BIGRAM_KINDS] = { "alternating", "same-hand", "same-finger", "same-key" };
+
+static struct {
+  bool      enabled;
+  uint64_t  presses;
+  uint64_t *bigrams;    // [KEYS][KEYS]
+  uint64_t *trigrams;   // [KEYS][KEYS][KEYS]
+  uint64_t  bigram_total, trigram_total;
+  uint64_t  kinds[BIGRAM_KINDS];
+  // Inter-key intervals, and their sum for every kind of bigram
+  uint64_t  intervals[INTERVAL_BUCKETS + 1];
+  uint64_t  interval_count[BIGRAM_KINDS];
+  double    interval_sum[BIGRAM_KINDS];
+  // The last two keys pressed, and when the last one was
+  int       history[2];
+  unsigned  history_len;
+  double    last_time;
+} analytics;
+
+static void analytics_init (void) {
+  analytics.bigrams = calloc (KEYS * KEYS, sizeof (uint64_t));
+  analytics.trigrams = calloc (KEYS * KEYS * KEYS, sizeof (uint64_t));
+  if (!analytics.bigrams || !analytics.trigrams) {
+    perror ("calloc");
+    exit (1);
+  }
+  analytics.last_time = NAN;
+  analytics.enabled = true;
+}
+
+// Time is in milliseconds, NAN when the log line had no timestamp.
+static void analytics_key (unsigned c, unsigned r, double time) {
+  int key = r * COLS + c, prev = analytics.history[0];
+  double interval = time - analytics.last_time;
+
+  analytics.presses++;
+
+  if (analytics.history_len >= 1) {
+    unsigned hand, finger, prev_hand, prev_finger;
+    int kind;
+
+    key_finger (c, r, &hand, &finger);
+    key_finger (prev % COLS, prev / COLS, &prev_hand, &prev_finger);
+    if (key == prev)
+      kind = BIGRAM_SAME_KEY;
+    else if (hand != prev_hand)
+      kind = BIGRAM_ALTERNATING;
+    else if (finger == prev_finger)
+      kind = BIGRAM_SAME_FINGER;
+    else
+      kind = BIGRAM_SAME_HAND;
+
+    analytics.bigrams[prev * KEYS + key]++;
+    analytics.bigram_total++;
+    analytics.kinds[kind]++;
+
+    // isgreaterequal() is false for NAN, and for intervals spanning a
+    // device timer wraparound
+    if (isgreaterequal (interval, 0)) {
+      unsigned bucket = interval / INTERVAL_BUCKET_MS;
+
+      // Longer intervals are pauses, not typing: they are only counted in
+      // the last bucket, and left out of the averages.
+      if (bucket < INTERVAL_BUCKETS) {
+        analytics.intervals[bucket]++;
+        analytics.interval_count[kind]++;
+        analytics.interval_sum[kind] += interval;
+      } else {
+        analytics.intervals[INTERVAL_BUCKETS]++;
+      }
+    }
+  }
+  if (analytics.history_len >= 2) {
+    analytics.trigrams[(analytics.history[1] * KEYS + prev) * KEYS + key]++;
+    analytics.trigram_total++;
+  }
+
+  analytics.history[1] = prev;
+  analytics.history[0] = key;
+  if (analytics.history_len < 2)
+    analytics.history_len++;
+  analytics.last_time = time;
+}
+
+static void count_key (layer_t *layer, unsigned c, unsigned r, unsigned pressed, double time) {
+  uint64_t n;
+
+  if (r >= ROWS || c >= COLS || !allowed[r][c] || !layer_has_layout (layer))
+    return;
+
+  n = ++layer->log[r][c];
+  layer->total++;
+  if (n > layer->max_cnt)
+    layer->max_cnt = n;
+
+  if (analytics.enabled && pressed)
+    analytics_key (c, r, time);
+}
+
+/* Parsing */
+
+static bool parse_uint (const char **p, const char *end, unsigned *v) {
+  const char *s = *p;
+
+  *v = 0;
+  while (s < end && *s >= '0' && *s <= '9')
+    *v = *v * 10 + (*s++ - '0');
+  if (s == *p)
+    return false;
+  *p = s;
+  return true;
+}
+
+static bool expect (const char **p, const char *end, const char *lit, size_t len) {
+  if ((size_t)(end - *p) < len || memcmp (*p, lit, len))
+    return false;
+  *p += len;
+  return true;
+}
+
+#define EXPECT(p, end, lit) expect (p, end, lit, sizeof (lit) - 1)
+
+static int hex_digit (char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+static bool parse_kl (const char *p, const char *end, double time) {
+  unsigned col, row, pressed;
+
+  if (!EXPECT (&p, end, "KL: col=") || !parse_uint (&p, end, &col) ||
+      !EXPECT (&p, end, ", row=") || !parse_uint (&p, end, &row) ||
+      !EXPECT (&p, end, ", pressed=") || !parse_uint (&p, end, &pressed) ||
+      !EXPECT (&p, end, ", layer="))
+    return false;
+
+  count_key (layer_get (p, end - p), row, col, pressed, time);
+  return true;
+}
+
+static bool parse_kb (const char *p, const char *end) {
+  unsigned dropped = 0;
+  const char *records;
+
+  if (!EXPECT (&p, end, "KB:"))
+    return false;
+  for (int i = 0; i < 4; i++) {
+    int d = p + i < end ? hex_digit (p[i]) : -1;
+
+    if (d < 0)
+      return false;
+    dropped = dropped << 4 | d;
+  }
+  p += 4;
+  if (!EXPECT (&p, end, ":"))
+    return false;
+
+  if (dropped != dropped_records) {
+    fprintf (stderr, "Keylogger dropped %u records\n", (dropped - dropped_records) % 0x10000);
+    dropped_records = dropped;
+  }
+
+  records = p;
+  while (p < end && hex_digit (*p) >= 0)
+    p++;
+
+  for (; p - records >= 12; records += 12) {
+    unsigned pos = hex_digit (records[0]) << 4 | hex_digit (records[1]);
+    unsigned layer = hex_digit (records[2]) << 4 | hex_digit (records[3]);
+    uint32_t time = 0;
+    char name[16];
+    layer_t *l;
+
+    if (layer < layer_name_count) {
+      l = layer_get (layer_names[layer], strlen (layer_names[layer]));
+    } else {
+      snprintf (name, sizeof (name), "L%u", layer);
+      l = layer_get (name, strlen (name));
+    }
+    for (int i = 4; i < 12; i++)
+      time = time << 4 | hex_digit (records[i]);
+    count_key (l, pos >> 4, (pos >> 1) & 7, pos & 1, time);
+  }
+  return true;
+}
+
+// The host timestamp of stamped-log lines, in milliseconds. Batches (also
+// when found in a stamped-log) carry the device's own timestamps, and
+// parse_kb() uses those. Older versions of log-to-heatmap.py expanded the
+// batches into KL: lines all stamped with the time the batch arrived: once
+// two lines share a stamp, the stamps are not the time of the key presses,
+// and no intervals are taken from them.
+static double stamp_time (const char *line, const char *p) {
+  static double last_stamp = NAN;
+  static bool stamps_batched;
+  double stamp;
+
+  if (p == line || *line < '0' || *line > '9')
+    return NAN;
+
+  stamp = strtod (line, NULL) * 1000;
+  if (stamp == last_stamp)
+    stamps_batched = true;
+  last_stamp = stamp;
+  return stamps_batched ? NAN : stamp;
+}
+
+static void parse_line (const char *line, const char *end) {
+  const char *p;
+
+  if (end > line && end[-1] == '\r')
+    end--;
+
+  for (p = line; (p = memmem (p, end - p, "KB:", 3)); p++)
+    if (parse_kb (p, end))
+      return;
+
+  for (p = line; (p = memmem (p, end - p, "KL: col=", 8)); p++) {
+    if (parse_kl (p, end, analytics.enabled ? stamp_time (line, p) : NAN))
+      return;
+  }
+}
+
+static int parse_file (FILE *f) {
+  static char buf[1 << 20];
+  size_t have = 0, n;
+
+  while ((n = fread (buf + have, 1, sizeof (buf) - have, f)) > 0 || have) {
+    char *p = buf, *end = buf + have + n, *nl;
+
+    have += n;
+    while ((nl = memchr (p, '\n', end - p))) {
+      parse_line (p, nl);
+      p = nl + 1;
+    }
+
+    if (!n || (p == buf && have == sizeof (buf))) {
+      // EOF without a final newline, or a line longer than the buffer
+      parse_line (p, end);
+      p = end;
+    }
+
+    have = end - p;
+    memmove (buf, p, have);
+    if (!n)
+      break;
+  }
+
+  return ferror (f) ? -1 : 0;
+}
+
+/* JSON, just enough to read the heatmap layouts, and write them back out
+ * the same way Python's json.dump() does. */
+
+typedef enum { J_NULL, J_BOOL, J_INT, J_FLOAT, J_STRING, J_ARRAY, J_OBJECT } json_type_t;
+
+typedef struct json json_t;
+struct json {
+  json_type_t type;
+  bool        b;
+  long long   i;
+  double      f;
+  char       *s;
+  size_t      len;
+  json_t    **items;
+  char      **keys;
+};
+
+static void *xmalloc (size_t size) {
+  void *p = calloc (1, size);
+
+  if (!p) {
+    perror ("calloc");
+    exit (1);
+  }
+  return p;
+}
+
+static void json_append (json_t *j, char *key, json_t *v) {
+  j->items = realloc (j->items, (j->len + 1) * sizeof (json_t *));
+  j->keys = realloc (j->keys, (j->len + 1) * sizeof (char *));
+  if (!j->items || !j->keys) {
+    perror ("realloc");
+    exit (1);
+  }
+  j->items[j->len] = v;
+  j->keys[j->len] = key;
+  j->len++;
+}
+
+static const char *json_ws (const char *p) {
+  while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+    p++;
+  return p;
+}
+
+static void utf8_put (char **o, unsigned cp) {
+  char *s = *o;
+
+  if (cp < 0x80) {
+    *s++ = cp;
+  } else if (cp < 0x800) {
+    *s++ = 0xc0 | cp >> 6;
+    *s++ = 0x80 | (cp & 0x3f);
+  } else if (cp < 0x10000) {
+    *s++ = 0xe0 | cp >> 12;
+    *s++ = 0x80 | ((cp >> 6) & 0x3f);
+    *s++ = 0x80 | (cp & 0x3f);
+  } else {
+    *s++ = 0xf0 | cp >> 18;
+    *s++ = 0x80 | ((cp >> 12) & 0x3f);
+    *s++ = 0x80 | ((cp >> 6) & 0x3f);
+    *s++ = 0x80 | (cp & 0x3f);
+  }
+  *o = s;
+}
+
+static const char *json_parse_string (const char *p, char **out) {
+  char *s = xmalloc (strlen (p) + 1), *o = s;
+
+  p++;
+  while (*p && *p != '"') {
+    if (*p != '\\') {
+      *o++ = *p++;
+      continue;
+    }
+    p++;
+    switch (*p) {
+    case 'n': *o++ = '\n'; break;
+    case 't': *o++ = '\t'; break;
+    case 'r': *o++ = '\r'; break;
+    case 'b': *o++ = '\b'; break;
+    case 'f': *o++ = '\f'; break;
+    case 'u': {
+      unsigned cp = strtoul ((char[]){ p[1], p[2], p[3], p[4], 0 }, NULL, 16);
+
+      p += 4;
+      if (cp >= 0xd800 && cp < 0xdc00 && p[1] == '\\' && p[2] == 'u') {
+        unsigned lo = strtoul ((char[]){ p[3], p[4], p[5], p[6], 0 }, NULL, 16);
+
+        cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+        p += 6;
+      }
+      utf8_put (&o, cp);
+      break;
+    }
+    default: *o++ = *p; break;
+    }
+    p++;
+  }
+  *o = 0;
+  *out = s;
+  return *p ? p + 1 : p;
+}
+
+static const char *json_parse (const char *p, json_t **out) {
+  json_t *j = xmalloc (sizeof (json_t));
+
+  p = json_ws (p);
+  *out = j;
+
+  if (*p == '{' || *p == '[') {
+    char close = *p == '{' ? '}' : ']';
+
+    j->type = *p == '{' ? J_OBJECT : J_ARRAY;
+    p = json_ws (p + 1);
+    while (*p && *p != close) {
+      char *key = NULL;
+      json_t *v;
+
+      if (j->type == J_OBJECT) {
+        p = json_parse_string (p, &key);
+        p = json_ws (p);
+        p++; // ':'
+      }
+      p = json_ws (json_parse (p, &v));
+      json_append (j, key, v);
+      if (*p == ',')
+        p = json_ws (p + 1);
+    }
+    return *p ? p + 1 : p;
+  }
+
+  if (*p == '"') {
+    j->type = J_STRING;
+    return json_parse_string (p, &j->s);
+  }
+
+  if (!strncmp (p, "true", 4) || !strncmp (p, "false", 5)) {
+    j->type = J_BOOL;
+    j->b = *p == 't';
+    return p + (j->b ? 4 : 5);
+  }
+
+  if (!strncmp (p, "null", 4)) {
+    j->type = J_NULL;
+    return p + 4;
+  } else {
+    const char *start = p;
+    char *end;
+
+    p += strspn (p, "+-0123456789");
+    if (*p == '.' || *p == 'e' || *p == 'E') {
+      j->type = J_FLOAT;
+      j->f = strtod (start, &end);
+    } else {
+      j->type = J_INT;
+      j->i = strtoll (start, &end, 10);
+    }
+    return end;
+  }
+}
+
+static json_t *json_load (const char *fn) {
+  FILE *f = fopen (fn, "r");
+  char *buf;
+  long size;
+  json_t *j;
+
+  if (!f)
+    return NULL;
+  fseek (f, 0, SEEK_END);
+  size = ftell (f);
+  rewind (f);
+  buf = xmalloc (size + 1);
+  if (fread (buf, 1, size, f) != (size_t)size) {
+    fclose (f);
+    free (buf);
+    return NULL;
+  }
+  fclose (f);
+
+  json_parse (buf, &j);
+  free (buf);
+  return j;
+}
+
+// Python's repr() of a float: the shortest digits that read back the same.
+static void json_write_float (FILE *f, double v) {
+  char buf[32], digits[20];
+  int exp, n = 0;
+
+  for (int p = 1; p <= 17; p++) {
+    snprintf (buf, sizeof (buf), "%.*e", p - 1, v);
+    if (strtod (buf, NULL) == v)
+      break;
+  }
+
+  // buf is now [-]d[.ddd]e[+-]xx
+  for (char *s = buf; *s != 'e'; s++)
+    if (*s >= '0' && *s <= '9')
+      digits[n++] = *s;
+  digits[n] = 0;
+  exp = atoi (strchr (buf, 'e') + 1);
+  while (n > 1 && digits[n - 1] == '0')
+    digits[--n] = 0;
+
+  if (v < 0)
+    fputc ('-', f);
+
+  if (exp < -4 || exp >= 16) {
+    fputc (digits[0], f);
+    if (n > 1)
+      fprintf (f, ".%s", digits + 1);
+    fprintf (f, "e%c%02d", exp < 0 ? '-' : '+', abs (exp));
+  } else if (exp < 0) {
+    fputs ("0.", f);
+    for (int i = 1; i < -exp; i++)
+      fputc ('0', f);
+    fputs (digits, f);
+  } else {
+    for (int i = 0; i <= exp; i++)
+      fputc (i < n ? digits[i] : '0', f);
+    fputc ('.', f);
+    fputs (n > exp + 1 ? digits + exp + 1 : "0", f);
+  }
+}
+
+static void json_write_string (FILE *f, const char *s) {
+  const unsigned char *p = (const unsigned char *)s;
+
+  fputc ('"', f);
+  while (*p) {
+    unsigned cp = *p++;
+
+    if (cp >= 0x80) {
+      int extra = cp >= 0xf0 ? 3 : cp >= 0xe0 ? 2 : 1;
+
+      cp &= 0x3f >> extra;
+      while (extra-- && *p)
+        cp = cp << 6 | (*p++ & 0x3f);
+    }
+
+    switch (cp) {
+    case '"': fputs ("\\\"", f); break;
+    case '\\': fputs ("\\\\", f); break;
+    case '\n': fputs ("\\n", f); break;
+    case '\r': fputs ("\\r", f); break;
+    case '\t': fputs ("\\t", f); break;
+    case '\b': fputs ("\\b", f); break;
+    case '\f': fputs ("\\f", f); break;
+    default:
+      if (cp >= 0x10000) {
+        cp -= 0x10000;
+        fprintf (f, "\\u%04x\\u%04x", 0xd800 | cp >> 10, 0xdc00 | (cp & 0x3ff));
+      } else if (cp < 0x20 || cp >= 0x7f) {
+        fprintf (f, "\\u%04x", cp);
+      } else {
+        fputc (cp, f);
+      }
+    }
+  }
+  fputc ('"', f);
+}
+
+static void json_write (FILE *f, const json_t *j) {
+  switch (j->type) {
+  case J_NULL: fputs ("null", f); break;
+  case J_BOOL: fputs (j->b ? "true" : "false", f); break;
+  case J_INT: fprintf (f, "%lld", j->i); break;
+  case J_FLOAT: json_write_float (f, j->f); break;
+  case J_STRING: json_write_string (f, j->s); break;
+  case J_ARRAY:
+  case J_OBJECT:
+    fputc (j->type == J_ARRAY ? '[' : '{', f);
+    for (size_t i = 0; i < j->len; i++) {
+      if (i)
+        fputs (", ", f);
+      if (j->type == J_OBJECT) {
+        json_write_string (f, j->keys[i]);
+        fputs (": ", f);
+      }
+      json_write (f, j->items[i]);
+    }
+    fputc (j->type == J_ARRAY ? ']' : '}', f);
+    break;
+  }
+}
+
+static void json_free (json_t *j) {
+  for (size_t i = 0; i < j->len; i++) {
+    json_free (j->items[i]);
+    free (j->keys[i]);
+  }
+  free (j->items);
+  free (j->keys);
+  free (j->s);
+  free (j);
+}
+
+/* Heatmap, as Heatmap.get_heatmap() in log-to-heatmap.py */
+
+static const int8_t coords[ROWS][COLS][2] = {
+  {
+    { 4,  0}, { 4,  2}, { 2,  0}, { 1,  0}, { 2,  2}, { 3,  0}, { 3,  2},
+    { 3,  4}, { 3,  6}, { 2,  4}, { 1,  2}, { 2,  6}, { 4,  4}, { 4,  6},
+  },
+  {
+    { 8,  0}, { 8,  2}, { 6,  0}, { 5,  0}, { 6,  2}, { 7,  0}, { 7,  2},
+    { 7,  4}, { 7,  6}, { 6,  4}, { 5,  2}, { 6,  6}, { 8,  4}, { 8,  6},
+  },
+  {
+    {12,  0}, {12,  2}, {10,  0}, { 9,  0}, {10,  2}, {11,  0}, {-1, -1},
+    {-1, -1}, {11,  2}, {10,  4}, { 9,  2}, {10,  6}, {12,  4}, {12,  6},
+  },
+  {
+    {17,  0}, {17,  2}, {15,  0}, {14,  0}, {15,  2}, {16,  0}, {13,  0},
+    {13,  2}, {16,  2}, {15,  4}, {14,  2}, {15,  6}, {17,  4}, {17,  6},
+  },
+  {
+    {20,  0}, {20,  2}, {19,  0}, {18,  0}, {19,  2}, {-1, -1}, {-1, -1},
+    {-1, -1}, {-1, -1}, {19,  4}, {18,  2}, {19,  6}, {20,  4}, {20,  6},
+  },
+  {
+    {-1, -1}, {23,  0}, {22,  2}, {22,  0}, {22,  4}, {21,  0}, {21,  2},
+    {24,  0}, {24,  2}, {25,  0}, {25,  4}, {25,  2}, {26,  0}, {-1, -1},
+  },
+};
+
+static json_t *json_at (json_t *layout, int block, int n) {
+  if (block >= (int)layout->len || layout->items[block]->type != J_ARRAY ||
+      n >= (int)layout->items[block]->len)
+    return NULL;
+  return layout->items[block]->items[n];
+}
+
+static void set_bg (json_t *layout, int block, int n, const char *color) {
+  json_t *blk = json_at (layout, block, n), *v;
+
+  if (!blk || blk->type != J_OBJECT)
+    return;
+
+  for (size_t i = 0; i < blk->len; i++) {
+    if (!strcmp (blk->keys[i], "c")) {
+      v = blk->items[i];
+      free (v->s);
+      v->type = J_STRING;
+      v->s = strdup (color);
+      return;
+    }
+  }
+
+  v = xmalloc (sizeof (json_t));
+  v->type = J_STRING;
+  v->s = strdup (color);
+  json_append (blk, strdup ("c"), v);
+}
+
+static void set_tap_info (json_t *layout, int block, int n, uint64_t count, uint64_t cap) {
+  json_t *label = json_at (layout, block, n + 1);
+  size_t newlines = 0, len;
+  char *s;
+
+  if (!label || label->type != J_STRING)
+    return;
+  if (!cap)
+    cap = 1;
+
+  len = strlen (label->s);
+  for (size_t i = 0; i < len; i++)
+    newlines += label->s[i] == '\n';
+
+  s = xmalloc (len + 4 + 32);
+  memcpy (s, label->s, len);
+  for (; newlines < 4; newlines++)
+    s[len++] = '\n';
+  snprintf (s + len, 32, "%.2f%%", (double)count / (double)cap * 100);
+
+  free (label->s);
+  label->s = s;
+}
+
+static void heatmap_color (double v, char *out) {
+  static const double colors[4][3] = {
+    {0.3, 0.3, 1}, {0.3, 1, 0.3}, {1, 1, 0.3}, {1, 0.3, 0.3}
+  };
+  double fb = 0, rgb[3];
+  int idx1, idx2;
+
+  if (v <= 0) {
+    idx1 = idx2 = 0;
+  } else if (v >= 1) {
+    idx1 = idx2 = 3;
+  } else {
+    double val = v * 3;
+
+    idx1 = (int)floor (val);
+    idx2 = idx1 + 1;
+    fb = val - (double)idx1;
+  }
+
+  for (int i = 0; i < 3; i++) {
+    volatile double x = (colors[idx2][i] - colors[idx1][i]) * fb;
+
+    x = x + colors[idx1][i];
+    rgb[i] = x * 255;
+  }
+  sprintf (out, "#%02x%02x%02x", (int)rgb[0], (int)rgb[1], (int)rgb[2]);
+}
+
+static int write_heatmap (const char *outdir, layer_t *layer) {
+  char fn[4096], color[8];
+  json_t *layout;
+  FILE *f;
+
+  snprintf (fn, sizeof (fn), "%s/heatmap-layout.%s.json", layouts_dir, layer->name);
+  if (!(layout = json_load (fn))) {
+    perror (fn);
+    return -1;
+  }
+
+  for (int r = 0; r < ROWS; r++)
+    for (int c = 0; c < COLS; c++)
+      if (coords[r][c][0] >= 0)
+        set_bg (layout, coords[r][c][0], coords[r][c][1], "#d9dae0");
+
+  for (int r = 0; r < ROWS; r++) {
+    for (int c = 0; c < COLS; c++) {
+      uint64_t cap = layer->max_cnt ? layer->max_cnt : 1;
+
+      if (!layer->log[r][c] || coords[r][c][0] < 0)
+        continue;
+
+      heatmap_color ((double)layer->log[r][c] / (double)cap, color);
+      set_bg (layout, coords[r][c][0], coords[r][c][1], color);
+      set_tap_info (layout, coords[r][c][0], coords[r][c][1], layer->log[r][c], layer->total);
+    }
+  }
+
+  snprintf (fn, sizeof (fn), "%s/%s.json", outdir, layer->name);
+  if (!(f = fopen (fn, "w"))) {
+    perror (fn);
+    json_free (layout);
+    return -1;
+  }
+  json_write (f, layout);
+  fclose (f);
+  json_free (layout);
+  return 0;
+}
+
+/* Statistics, as Heatmap.get_stats() in log-to-heatmap.py */
+
+static void write_percent (FILE *f, uint64_t n, uint64_t total) {
+  char buf[32];
+
+  snprintf (buf, sizeof (buf), "%.2f", (double)n / (double)total * 100);
+  json_write_float (f, strtod (buf, NULL));
+}
+
+static void write_stats (FILE *f, layer_t *layer) {
+  static const char *fingers[2][5] = {
+    { "pinky", "ring", "middle", "index", "thumb" },
+    { "thumb", "index", "middle", "ring", "pinky" },
+  };
+  uint64_t usage[2][5] = { { 0 } }, hand_usage[2] = { 0 };
+  uint64_t total = layer->total ? layer->total : 1;
+
+  for (int r = 0; r < ROWS; r++) {
+    for (int c = 0; c < COLS; c++) {
+      uint64_t n = layer->log[r][c];
+
+      unsigned hand, finger;
+
+      if (!n)
+        continue;
+      key_finger (c, r, &hand, &finger);
+      usage[hand][finger] += n;
+    }
+  }
+
+  for (int h = 0; h < 2; h++)
+    for (int i = 0; i < 5; i++)
+      hand_usage[h] += usage[h][i];
+
+  fprintf (f, "{\"total-keys\": %" PRIu64 ", \"hands\": {", total);
+  for (int h = 0; h < 2; h++) {
+    fprintf (f, "%s\"%s\": {\"usage\": ", h ? ", " : "", h ? "right" : "left");
+    write_percent (f, hand_usage[h], total);
+    fputs (", \"fingers\": {", f);
+    for (int i = 0; i < 5; i++) {
+      fprintf (f, "%s\"%s\": ", i ? ", " : "", fingers[h][i]);
+      write_percent (f, usage[h][i], total);
+    }
+    fputs ("}}", f);
+  }
+  fputs ("}}", f);
+}
+
+/* Analytics output */
+
+static void write_key (FILE *f, int key) {
+  fprintf (f, "[%d, %d]", key % COLS, key / COLS);
+}
+
+// The NGRAM_TOP most frequent n-grams in counts, with n keys each.
+static void write_top_ngrams (FILE *f, const uint64_t *counts, int n) {
+  size_t size = n == 2 ? KEYS * KEYS : KEYS * KEYS * KEYS;
+  size_t top[NGRAM_TOP];
+  int len = 0;
+
+  for (size_t i = 0; i < size; i++) {
+    int j;
+
+    if (!counts[i] || (len == NGRAM_TOP && counts[i] <= counts[top[len - 1]]))
+      continue;
+    if (len < NGRAM_TOP)
+      len++;
+    for (j = len - 1; j > 0 && counts[top[j - 1]] < counts[i]; j--)
+      top[j] = top[j - 1];
+    top[j] = i;
+  }
+
+  fputc ('[', f);
+  for (int i = 0; i < len; i++) {
+    size_t ngram = top[i];
+    int keys[3];
+
+    for (int k = n - 1; k >= 0; k--) {
+      keys[k] = ngram % KEYS;
+      ngram /= KEYS;
+    }
+
+    fputs (i ? ", {\"keys\": [" : "{\"keys\": [", f);
+    for (int k = 0; k < n; k++) {
+      if (k)
+        fputs (", ", f);
+      write_key (f, keys[k]);
+    }
+    fprintf (f, "], \"count\": %" PRIu64 "}", counts[top[i]]);
+  }
+  fputc (']', f);
+}
+
+static int write_analytics (const char *fn) {
+  uint64_t bigrams = analytics.bigram_total ? analytics.bigram_total : 1;
+  uint64_t intervals = 0, seen = 0;
+  FILE *f = fopen (fn, "w");
+
+  if (!f) {
+    perror (fn);
+    return -1;
+  }
+
+  fprintf (f, "{\"presses\": %" PRIu64 ", \"bigrams\": {\"total\": %" PRIu64,
+           analytics.presses, analytics.bigram_total);
+  for (int k = 0; k < BIGRAM_KINDS; k++) {
+    fprintf (f, ", \"%s\": ", bigram_kinds[k]);
+    write_percent (f, analytics.kinds[k], bigrams);
+  }
+  fputs (", \"top\": ", f);
+  write_top_ngrams (f, analytics.bigrams, 2);
+
+  fprintf (f, "}, \"trigrams\": {\"total\": %" PRIu64 ", \"top\": ", analytics.trigram_total);
+  write_top_ngrams (f, analytics.trigrams, 3);
+
+  for (int i = 0; i <= INTERVAL_BUCKETS; i++)
+    intervals += analytics.intervals[i];
+
+  fprintf (f, "}, \"intervals\": {\"total\": %" PRIu64 ", \"median-ms\": ", intervals);
+  for (int i = 0; i <= INTERVAL_BUCKETS; i++) {
+    seen += analytics.intervals[i];
+    if (intervals && seen * 2 >= intervals && i < INTERVAL_BUCKETS) {
+      fprintf (f, "%d", i * INTERVAL_BUCKET_MS + INTERVAL_BUCKET_MS / 2);
+      break;
+    }
+    if (i == INTERVAL_BUCKETS || (intervals && seen * 2 >= intervals)) {
+      fputs ("null", f);
+      break;
+    }
+  }
+
+  fputs (", \"mean-ms\": {", f);
+  for (int k = 0; k < BIGRAM_KINDS; k++) {
+    fprintf (f, "%s\"%s\": ", k ? ", " : "", bigram_kinds[k]);
+    if (analytics.interval_count[k])
+      json_write_float (f, round (analytics.interval_sum[k] / analytics.interval_count[k] * 100) / 100);
+    else
+      fputs ("null", f);
+  }
+  fprintf (f, "}, \"bucket-ms\": %d, \"histogram\": [", INTERVAL_BUCKET_MS);
+  for (int i = 0; i <= INTERVAL_BUCKETS; i++)
+    fprintf (f, i ? ", %" PRIu64 : "%" PRIu64, analytics.intervals[i]);
+  fputs ("]}}\n", f);
+
+  fclose (f);
+  return 0;
+}
+
+/* Main */
+
+static int layer_cmp (const void *a, const void *b) {
+  return strcmp (((const layer_t *)a)->name, ((const layer_t *)b)->name);
+}
+
+static bool parse_key (const char *arg, unsigned *c, unsigned *r) {
+  const char *p = arg + strcspn (arg, "0123456789");
+
+  return sscanf (p, "%u,%u", c, r) == 2;
+}
+
+// path, relative to the directory of this program
+static char *program_path (const char *argv0, const char *path) {
+  const char *slash = strrchr (argv0, '/');
+  char *s;
+
+  if (asprintf (&s, "%.*s%s", slash ? (int)(slash - argv0 + 1) : 0, argv0, path) < 0) {
+    perror ("asprintf");
+    exit (1);
+  }
+  return s;
+}
+
+static void usage (const char *name) {
+  fprintf (stderr,
+           "Usage: %s [options] OUTDIR [LOG...]\n"
+           "\n"
+           "Reads keylogger output from the LOG files (or the standard input), and\n"
+           "writes a heatmap for every layer into OUTDIR, then prints the finger\n"
+           "usage statistics of each, as JSON.\n"
+           "\n"
+           "  --ignore-key C,R   ignore the key at position (C, R)\n"
+           "  --only-key C,R     only include the key at position (C, R)\n"
+           "  --layouts DIR      where the heatmap-layout.*.json files are\n"
+           "                     (default: the parent directory of this program)\n"
+           "  --keymap FILE      the keymap to take the layer names from\n"
+           "                     (default: keymap.c, two directories up)\n"
+           "  --analytics FILE   write n-gram, same-finger, hand alternation and\n"
+           "                     inter-key interval statistics into FILE\n",
+           name);
+}
+
+int main (int argc, char *argv[]) {
+  static const struct option long_options[] = {
+    { "ignore-key", required_argument, NULL, 'i' },
+    { "only-key", required_argument, NULL, 'o' },
+    { "layouts", required_argument, NULL, 'l' },
+    { "keymap", required_argument, NULL, 'k' },
+    { "analytics", required_argument, NULL, 'a' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 },
+  };
+  bool ignore = false, only = false;
+  char *keymap_fn = NULL, *analytics_fn = NULL, *outdir;
+  unsigned c, r;
+  int opt, ret = 0;
+
+  for (r = 0; r < ROWS; r++)
+    for (c = 0; c < COLS; c++)
+      allowed[r][c] = true;
+
+  while ((opt = getopt_long (argc, argv, "h", long_options, NULL)) != -1) {
+    switch (opt) {
+    case 'i':
+    case 'o':
+      if (!parse_key (optarg, &c, &r))
+        break;
+      if (opt == 'o' && !only) {
+        memset (allowed, 0, sizeof (allowed));
+        only = true;
+      }
+      if (opt == 'i')
+        ignore = true;
+      if (r < ROWS && c < COLS)
+        allowed[r][c] = opt == 'o';
+      break;
+    case 'l':
+      layouts_dir = optarg;
+      break;
+    case 'k':
+      keymap_fn = optarg;
+      break;
+    case 'a':
+      analytics_fn = optarg;
+      analytics_init ();
+      break;
+    case 'h':
+      usage (argv[0]);
+      return 0;
+    default:
+      usage (argv[0]);
+      return 1;
+    }
+  }
+
+  if (ignore && only) {
+    fprintf (stderr, "--ignore-key and --only-key are mutually exclusive, please only use one of them!\n");
+    return 1;
+  }
+  if (optind >= argc) {
+    usage (argv[0]);
+    return 1;
+  }
+  outdir = argv[optind++];
+  mkdir (outdir, 0777);
+
+  if (!layouts_dir)
+    layouts_dir = program_path (argv[0], "..");
+  if (!keymap_fn)
+    keymap_fn = program_path (argv[0], "../../keymap.c");
+  if (read_layer_names (keymap_fn) < 0)
+    return 1;
+
+  if (optind == argc && parse_file (stdin) < 0) {
+    perror ("stdin");
+    return 1;
+  }
+  for (; optind < argc; optind++) {
+    FILE *f = fopen (argv[optind], "r");
+
+    if (!f || parse_file (f) < 0) {
+      perror (argv[optind]);
+      return 1;
+    }
+    fclose (f);
+  }
+
+  qsort (layers, layer_count, sizeof (layer_t), layer_cmp);
+
+  fputc ('{', stdout);
+  for (size_t i = 0, n = 0; i < layer_count; i++) {
+    if (!layers[i].total)
+      continue;
+    if (write_heatmap (outdir, &layers[i]) < 0)
+      ret = 1;
+
+    if (n++)
+      fputs (", ", stdout);
+    json_write_string (stdout, layers[i].name);
+    fputs (": ", stdout);
+    write_stats (stdout, &layers[i]);
+  }
+  fputs ("}\n", stdout);
+
+  if (analytics_fn && write_analytics (analytics_fn) < 0)
+    ret = 1;
+
+  return ret;
+}
@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+#
+# Runs a few commands through hid-commands against a stub window manager
+# (wmctrl, xdotool and notify-send replaced by shell scripts that log what
+# they were asked to do), and checks that the focus changes happen in the
+# order the commands arrived, and that only one notification is shown for
+# AppSel presses close together.
+#
+# Usage: hid-commands-check.py
+#
+# The stub wmctrl takes longer to activate the windows asked for first, so
+# commands that raced each other would change the focus out of order.
+
+import os
+import subprocess
+import sys
+import tempfile
+
+from os.path import abspath, dirname, join
+
+WINDOWS = """\
+0x01 0 emacs.Emacs host emacs
+0x02 0 gnome-terminal-server.Gnome-terminal host Terminal
+0x03 0 google-chrome.Google-chrome host Chrome
+0x04 0 keepassxc.KeePassXC host KeePassXC
+0x05 0 signal.Signal host Signal
+"""
+
+STUBS = {
+    "wmctrl": """\
+case "$1" in
+  -lx) cat "$STUB_DIR/windows" ;;
+  -i) case "$3" in
+        0x01) sleep 0.3 ;;
+        0x02) sleep 0.2 ;;
+        0x03) sleep 0.1 ;;
+      esac
+      echo "activate $3" >> "$STUB_DIR/focus" ;;
+  *) echo "wmctrl $*" >> "$STUB_DIR/focus" ;;
+esac
+""",
+    "xdotool": """\
+case "$1" in
+  getactivewindow) echo 0x03 ;;
+  *) echo "xdotool $*" >> "$STUB_DIR/focus" ;;
+esac
+""",
+    "notify-send": """\
+echo "$3" >> "$STUB_DIR/notify"
+""",
+}
+
+COMMANDS = [
+    "appsel_start",
+    "appsel_emacs",
+    "appsel_start",
+    "appsel_term",
+    "appsel_chrome",
+    "appsel_social2",
+    "appsel_pwmgr",
+    "no_such_command",
+]
+
+EXPECTED_FOCUS = [
+    "activate 0x01",
+    "xdotool key Escape",
+    "activate 0x02",
+    "xdotool key Escape",
+    "activate 0x03",
+    "xdotool key Escape",
+    # appsel_social2: Viber is not open, Signal is, then the focus goes back
+    "activate 0x05",
+    "xdotool windowfocus 0x03 windowactivate 0x03",
+    "xdotool key Escape",
+    "activate 0x04",
+    "xdotool key Escape",
+]
+
+def read_lines(fn):
+    try:
+        with open(fn) as f:
+            return f.read().splitlines()
+    except IOError:
+        return []
+
+def main():
+    failed = False
+
+    with tempfile.TemporaryDirectory() as stub_dir:
+        with open(join(stub_dir, "windows"), "w") as f:
+            f.write(WINDOWS)
+
+        env = dict(os.environ, STUB_DIR = stub_dir)
+        env.pop("DISABLE_APPSEL_START", None)
+        for (name, body) in STUBS.items():
+            fn = join(stub_dir, name)
+            with open(fn, "w") as f:
+                f.write("#!/bin/sh\n" + body)
+            os.chmod(fn, 0o755)
+            env[name.upper().replace("-", "_")] = fn
+
+        proc = subprocess.run([join(dirname(abspath(__file__)), "hid-commands")],
+                              input = "".join("CMD:%s\n" % c for c in COMMANDS),
+                              stdout = subprocess.PIPE, env = env,
+                              universal_newlines = True, timeout = 30)
+
+        focus = read_lines(join(stub_dir, "focus"))
+        notify = read_lines(join(stub_dir, "notify"))
+
+    done = [line for line in proc.stdout.splitlines() if line.startswith("Done: ")]
+
+    if proc.returncode != 0:
+        print ("hid-commands exited with %d" % proc.returncode)
+        failed = True
+    if focus != EXPECTED_FOCUS:
+        print ("Focus changes:\n  %s\nexpected:\n  %s" %
+               ("\n  ".join(focus), "\n  ".join(EXPECTED_FOCUS)))
+        failed = True
+    if len(notify) != 1:
+        print ("Notifications: %d, expected 1" % len(notify))
+        failed = True
+    if len(done) != len(COMMANDS) - 1:
+        print ("Commands done: %d, expected %d" % (len(done), len(COMMANDS) - 1))
+        failed = True
+
+    if failed:
+        sys.exit(1)
+    print ("hid-commands: OK")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1 @@
+#include "qmk-sim.h"
@@ -0,0 +1,9 @@
+/*
+ * Host-side stand-in for the AVR timer internals: the virtual clock has
+ * no finer resolution than a millisecond, so the tick counter stays at 0.
+ */
+
+#include "qmk-sim.h"
+
+#define TIMER_RAW 0
+#define TIMER_RAW_TOP 250
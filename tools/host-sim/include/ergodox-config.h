@@ -0,0 +1 @@
+/* Keyboard-level configuration the keymap's config.h builds on. */
@@ -0,0 +1,30 @@
+#ifndef KEYMAP_PLOVER_SIM_H
+#define KEYMAP_PLOVER_SIM_H
+
+#include "qmk-sim.h"
+
+#define PV_NUM  KC_1
+#define PV_LS   KC_Q
+#define PV_LT   KC_W
+#define PV_LP   KC_E
+#define PV_LH   KC_R
+#define PV_LK   KC_S
+#define PV_LW   KC_D
+#define PV_LR   KC_F
+#define PV_STAR KC_T
+#define PV_RF   KC_U
+#define PV_RP   KC_I
+#define PV_RL   KC_O
+#define PV_RT   KC_P
+#define PV_RD   KC_LBRC
+#define PV_RR   KC_J
+#define PV_RB   KC_K
+#define PV_RG   KC_L
+#define PV_RS   KC_SCLN
+#define PV_RZ   KC_QUOT
+#define PV_A    KC_C
+#define PV_O    KC_V
+#define PV_E    KC_N
+#define PV_U    KC_M
+
+#endif
@@ -0,0 +1,456 @@
+/*
+ * Host-side stand-ins for the parts of QMK that keymap.c uses.
+ *
+ * The names, signatures and keycode values follow QMK closely enough that
+ * keymap.c compiles unmodified; the behaviour is a simplified model that
+ * runs against a virtual clock and counts everything the keymap does.
+ */
+
+#ifndef QMK_SIM_H
+#define QMK_SIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Platform */
+
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define pgm_read_ptr(p) (*(void * const *)(p))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcpy_P strcpy
+
+#ifndef QMK_KEYBOARD
+# define QMK_KEYBOARD "ergodox_ez"
+#endif
+#ifndef QMK_KEYMAP
+# define QMK_KEYMAP "algernon"
+#endif
+
+#define MATRIX_ROWS 14
+#define MATRIX_COLS 6
+
+#ifndef TAPPING_TERM
+# define TAPPING_TERM 200
+#endif
+#ifndef LEADER_TIMEOUT
+# define LEADER_TIMEOUT 300
+#endif
+#ifndef UNICODE_TYPE_DELAY
+# define UNICODE_TYPE_DELAY 10
+#endif
+#ifndef UCIS_MAX_SYMBOL_LENGTH
+# define UCIS_MAX_SYMBOL_LENGTH 32
+#endif
+
+#define LED_BRIGHTNESS_LO 15
+#define LED_BRIGHTNESS_HI 255
+
+/* Keycodes */
+
+enum hid_keyboard_keypad_usage {
+  KC_NO = 0x00, KC_TRNS,
+  KC_A = 0x04, KC_B, KC_C, KC_D, KC_E, KC_F, KC_G, KC_H, KC_I, KC_J, KC_K,
+  KC_L, KC_M, KC_N, KC_O, KC_P, KC_Q, KC_R, KC_S, KC_T, KC_U, KC_V, KC_W,
+  KC_X, KC_Y, KC_Z,
+  KC_1, KC_2, KC_3, KC_4, KC_5, KC_6, KC_7, KC_8, KC_9, KC_0,
+  KC_ENT, KC_ESC, KC_BSPC, KC_TAB, KC_SPC, KC_MINS, KC_EQL, KC_LBRC, KC_RBRC,
+  KC_BSLS, KC_NUHS, KC_SCLN, KC_QUOT, KC_GRV, KC_COMM, KC_DOT, KC_SLSH,
+  KC_CAPS,
+  KC_F1, KC_F2, KC_F3, KC_F4, KC_F5, KC_F6, KC_F7, KC_F8, KC_F9, KC_F10,
+  KC_F11, KC_F12,
+  KC_PSCR, KC_SLCK, KC_PAUS, KC_INS, KC_HOME, KC_PGUP, KC_DEL, KC_END,
+  KC_PGDN, KC_RGHT, KC_LEFT, KC_DOWN, KC_UP,
+
+  /* Consumer page keys, in TMK's internal numbering */
+  KC_MUTE = 0xA8, KC_VOLU, KC_VOLD, KC_MNXT, KC_MPRV, KC_MSTP, KC_MPLY,
+
+  KC_LCTL = 0xE0, KC_LSFT, KC_LALT, KC_LGUI, KC_RCTL, KC_RSFT, KC_RALT, KC_RGUI,
+};
+
+#define KC_LCTRL KC_LCTL
+#define KC_RCTRL KC_RCTL
+#define KC_EXSEL 0xA4
+
+#define IS_KEY(kc) ((kc) >= KC_A && (kc) <= KC_EXSEL)
+
+#define IS_MOD(kc) ((kc) >= KC_LCTL && (kc) <= KC_RGUI)
+#define IS_CONSUMER(kc) ((kc) >= KC_MUTE && (kc) <= KC_MPLY)
+
+enum quantum_keycodes {
+  QK_MODS           = 0x0100,
+  QK_LCTL           = 0x0100,
+  QK_LSFT           = 0x0200,
+  QK_LALT           = 0x0400,
+  QK_LGUI           = 0x0800,
+  QK_RMODS_MIN      = 0x1000,
+  QK_RCTL           = 0x1100,
+  QK_RSFT           = 0x1200,
+  QK_RALT           = 0x1400,
+  QK_RGUI           = 0x1800,
+  QK_MODS_MAX       = 0x1FFF,
+  QK_FUNCTION       = 0x2000,
+  QK_FUNCTION_MAX   = 0x2FFF,
+  QK_MACRO          = 0x3000,
+  QK_MACRO_MAX      = 0x3FFF,
+  QK_ONE_SHOT_LAYER = 0x5400,
+  QK_ONE_SHOT_LAYER_MAX = 0x54FF,
+  QK_TAP_DANCE      = 0x5700,
+  QK_TAP_DANCE_MAX  = 0x57FF,
+
+  KC_LEAD           = 0x5C10,
+  SAFE_RANGE,
+};
+
+#define LCTL(kc) ((kc) | QK_LCTL)
+#define LSFT(kc) ((kc) | QK_LSFT)
+#define LALT(kc) ((kc) | QK_LALT)
+#define LGUI(kc) ((kc) | QK_LGUI)
+#define RSFT(kc) ((kc) | QK_RSFT)
+#define RALT(kc) ((kc) | QK_RALT)
+
+#define KC_DQT  LSFT(KC_QUOT)
+#define KC_COLN LSFT(KC_SCLN)
+#define KC_LPRN LSFT(KC_9)
+#define KC_RPRN LSFT(KC_0)
+
+#define F(kc)   ((kc) | QK_FUNCTION)
+#define M(kc)   ((kc) | QK_MACRO)
+#define OSL(l)  ((l) | QK_ONE_SHOT_LAYER)
+#define TD(n)   (QK_TAP_DANCE | ((n) & 0xFF))
+
+#define MOD_LCTL 0x01
+#define MOD_LSFT 0x02
+#define MOD_LALT 0x04
+#define MOD_LGUI 0x08
+#define MOD_BIT(code) (1 << ((code) & 0x07))
+
+/* Reports & records */
+
+typedef struct {
+  uint8_t mods;
+  uint8_t keys[32];
+} report_keyboard_t;
+
+extern report_keyboard_t *keyboard_report;
+
+typedef struct {
+  uint8_t col;
+  uint8_t row;
+} keypos_t;
+
+typedef struct {
+  keypos_t key;
+  bool     pressed;
+  uint16_t time;
+} keyevent_t;
+
+typedef struct {
+  bool    interrupted :1;
+  bool    reserved2   :1;
+  bool    reserved1   :1;
+  bool    reserved0   :1;
+  uint8_t count       :4;
+} tap_t;
+
+typedef struct {
+  keyevent_t event;
+  tap_t tap;
+} keyrecord_t;
+
+void register_code (uint8_t code);
+void unregister_code (uint8_t code);
+void register_code16 (uint16_t code);
+void unregister_code16 (uint16_t code);
+void send_keyboard_report (void);
+void reset_keyboard (void);
+
+uint8_t get_mods (void);
+void add_mods (uint8_t mods);
+void del_mods (uint8_t mods);
+void set_mods (uint8_t mods);
+void clear_mods (void);
+void add_key (uint8_t key);
+void del_key (uint8_t key);
+void clear_keys (void);
+
+/* Layers */
+
+extern uint32_t layer_state;
+extern uint32_t default_layer_state;
+
+uint8_t biton32 (uint32_t bits);
+void layer_on (uint8_t layer);
+void layer_off (uint8_t layer);
+void layer_invert (uint8_t layer);
+void layer_clear (void);
+void default_layer_set (uint32_t state);
+void default_layer_and (uint32_t state);
+void default_layer_or (uint32_t state);
+
+/* One-shot modifiers and layers */
+
+#define ONESHOT_PRESSED           0x01
+#define ONESHOT_OTHER_KEY_PRESSED 0x02
+#define ONESHOT_START             0x03
+#define ONESHOT_TOGGLED           0x04
+
+void set_oneshot_mods (uint8_t mods);
+uint8_t get_oneshot_mods (void);
+void clear_oneshot_mods (void);
+bool has_oneshot_mods_timed_out (void);
+void set_oneshot_layer (uint8_t layer, uint8_t state);
+void clear_oneshot_layer_state (uint8_t state);
+
+/* Actions */
+
+#define ON_PRESS 1
+
+#define ACT_LAYER_CLEAR   0xA000
+#define ACT_LAYER_INVERT  0xA100
+#define ACT_MACRO_TAP     0xC000
+#define ACT_MODS_ONESHOT  0xD000
+
+#define ACTION_LAYER_CLEAR(on)          (ACT_LAYER_CLEAR)
+#define ACTION_LAYER_INVERT(layer, on)  (ACT_LAYER_INVERT | (layer))
+#define ACTION_MACRO_TAP(id)            (ACT_MACRO_TAP | (id))
+#define ACTION_MODS_ONESHOT(mods)       (ACT_MODS_ONESHOT | (mods))
+
+extern const uint16_t fn_actions[];
+
+/* Macros */
+
+typedef uint8_t macro_t;
+
+enum macro_command_id {
+  END = 0x00,
+  KEY_DOWN,
+  KEY_UP,
+  WAIT = 0x74,
+  INTERVAL,
+};
+
+#define MACRO_NONE ((macro_t *)0)
+#define MACRO(...) ({ static const macro_t __m[] PROGMEM = { __VA_ARGS__ }; &__m[0]; })
+#define DOWN(key) KEY_DOWN, (key)
+#define UP(key) KEY_UP, (key)
+#define TYPE(key) DOWN(key), UP(key)
+#define D(key) DOWN(KC_##key)
+#define U(key) UP(KC_##key)
+#define T(key) TYPE(KC_##key)
+#define W(ms) WAIT, (ms)
+
+const macro_t *action_get_macro (keyrecord_t *record, uint8_t id, uint8_t opt);
+void action_macro_play (const macro_t *macro_p);
+
+bool process_record_user (uint16_t keycode, keyrecord_t *record);
+void matrix_init_user (void);
+void matrix_scan_user (void);
+
+/* Tap dance */
+
+typedef struct {
+  uint8_t  count;
+  uint8_t  oneshot_mods;
+  uint16_t keycode;
+  uint16_t timer;
+  bool     interrupted;
+  bool     pressed;
+  bool     finished;
+} qk_tap_dance_state_t;
+
+typedef void (*qk_tap_dance_user_fn_t) (qk_tap_dance_state_t *state, void *user_data);
+
+typedef struct {
+  struct {
+    qk_tap_dance_user_fn_t on_each_tap;
+    qk_tap_dance_user_fn_t on_dance_finished;
+    qk_tap_dance_user_fn_t on_reset;
+  } fn;
+  qk_tap_dance_state_t state;
+  void *user_data;
+} qk_tap_dance_action_t;
+
+typedef struct {
+  uint16_t kc1;
+  uint16_t kc2;
+} qk_tap_dance_pair_t;
+
+void qk_tap_dance_pair_finished (qk_tap_dance_state_t *state, void *user_data);
+void qk_tap_dance_pair_reset (qk_tap_dance_state_t *state, void *user_data);
+
+#define ACTION_TAP_DANCE_DOUBLE(kc1, kc2) {                               \
+    .fn = { NULL, qk_tap_dance_pair_finished, qk_tap_dance_pair_reset },  \
+    .user_data = (void *)&((qk_tap_dance_pair_t) { kc1, kc2 }),           \
+  }
+#define ACTION_TAP_DANCE_FN(user_fn) {          \
+    .fn = { NULL, user_fn, NULL },              \
+    .user_data = NULL,                          \
+  }
+#define ACTION_TAP_DANCE_FN_ADVANCED(user_fn_on_each_tap, user_fn_on_dance_finished, user_fn_on_dance_reset) { \
+    .fn = { user_fn_on_each_tap, user_fn_on_dance_finished, user_fn_on_dance_reset }, \
+    .user_data = NULL,                                                  \
+  }
+
+extern qk_tap_dance_action_t tap_dance_actions[];
+
+void reset_tap_dance (qk_tap_dance_state_t *state);
+
+/* Leader */
+
+extern bool leading;
+extern uint16_t leader_time;
+extern uint16_t leader_sequence[5];
+extern uint8_t leader_sequence_size;
+
+void leader_start (void);
+void leader_end (void);
+
+#define LEADER_EXTERNS()                                                \
+  extern bool leading;                                                  \
+  extern uint16_t leader_time;                                          \
+  extern uint16_t leader_sequence[5];                                   \
+  extern uint8_t leader_sequence_size
+#define LEADER_DICTIONARY() if (leading && timer_elapsed (leader_time) > LEADER_TIMEOUT)
+
+#define SEQ_ONE_KEY(key)                                                \
+  if (leader_sequence[0] == (key) && leader_sequence[1] == 0 &&         \
+      leader_sequence[2] == 0 && leader_sequence[3] == 0 && leader_sequence[4] == 0)
+#define SEQ_TWO_KEYS(key1, key2)                                        \
+  if (leader_sequence[0] == (key1) && leader_sequence[1] == (key2) &&   \
+      leader_sequence[2] == 0 && leader_sequence[3] == 0 && leader_sequence[4] == 0)
+#define SEQ_THREE_KEYS(key1, key2, key3)                                \
+  if (leader_sequence[0] == (key1) && leader_sequence[1] == (key2) &&   \
+      leader_sequence[2] == (key3) && leader_sequence[3] == 0 &&        \
+      leader_sequence[4] == 0)
+
+/* Unicode & UCIS */
+
+#define UC_OSX 0
+#define UC_LNX 1
+#define UC_WIN 2
+
+void set_unicode_input_mode (uint8_t os_target);
+void unicode_input_start (void);
+void unicode_input_finish (void);
+void register_hex (uint16_t hex);
+
+#ifdef UCIS_ENABLE
+typedef struct {
+  char *symbol;
+  char *code;
+} qk_ucis_symbol_t;
+
+typedef struct {
+  uint8_t  count;
+  uint16_t codes[UCIS_MAX_SYMBOL_LENGTH];
+  bool     in_progress :1;
+} qk_ucis_state_t;
+
+extern qk_ucis_state_t qk_ucis_state;
+extern const qk_ucis_symbol_t ucis_symbol_table[];
+
+#define UCIS_TABLE(...) { __VA_ARGS__, { NULL, NULL } }
+#define UCIS_SYM(name, code) { name, #code }
+
+void qk_ucis_start (void);
+void qk_ucis_start_user (void);
+void qk_ucis_symbol_fallback (void);
+void register_ucis (const char *hex);
+#endif
+
+/* Strings, printing, timing */
+
+#define SEND_STRING(str) send_string (str)
+void send_string (const char *str);
+
+int uprintf (const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
+
+/* Raw HID */
+
+void raw_hid_send (uint8_t *data, uint8_t length);
+void raw_hid_receive (uint8_t *data, uint8_t length);
+
+/* Virtual serial */
+
+void virtser_send (const uint8_t byte);
+
+uint16_t timer_read (void);
+uint32_t timer_read32 (void);
+uint16_t timer_elapsed (uint16_t last);
+uint32_t timer_elapsed32 (uint32_t last);
+
+void wait_ms (uint16_t ms);
+
+/* EEPROM */
+
+bool eeconfig_is_enabled (void);
+void eeconfig_init (void);
+uint8_t eeconfig_read_default_layer (void);
+void eeconfig_update_default_layer (uint8_t val);
+
+/* ErgoDox EZ LEDs */
+
+void ergodox_right_led_1_on (void);
+void ergodox_right_led_2_on (void);
+void ergodox_right_led_3_on (void);
+void ergodox_right_led_1_off (void);
+void ergodox_right_led_2_off (void);
+void ergodox_right_led_3_off (void);
+void ergodox_right_led_1_set (uint8_t n);
+void ergodox_right_led_2_set (uint8_t n);
+void ergodox_right_led_3_set (uint8_t n);
+void ergodox_led_all_on (void);
+void ergodox_led_all_off (void);
+void ergodox_led_all_set (uint8_t n);
+
+/* Simulator interface, used by sim.c only */
+
+typedef struct {
+  uint64_t events;
+  uint64_t scans;
+  uint64_t reports;
+  uint64_t led_writes;
+  uint64_t console_bytes;
+  uint64_t console_lines;
+  uint64_t raw_reports;
+  uint64_t serial_bytes;
+  uint64_t steno_strokes;
+  uint64_t steno_errors;
+  uint64_t wait_calls;
+  uint64_t wait_ms;
+  uint64_t delayed_events;
+  uint64_t delay_ms_max;
+  uint64_t resets;
+} sim_stats_t;
+
+enum {
+  SIM_PROF_SCAN = 0,
+  SIM_PROF_RECORD,
+  SIM_PROF_MACRO,
+  SIM_PROF_FNS
+};
+
+typedef struct {
+  uint64_t calls;
+  uint64_t ns;
+} sim_prof_t;
+
+extern sim_stats_t sim_stats;
+extern sim_prof_t sim_prof[SIM_PROF_FNS];
+extern uint32_t sim_now;
+extern bool sim_verbose;
+extern bool sim_profile;
+extern FILE *sim_output;
+
+void sim_init (uint8_t default_layer);
+void sim_scan (void);
+uint16_t sim_key_event (uint8_t row, uint8_t col, bool pressed);
+
+#endif
@@ -0,0 +1,2 @@
+#define QMK_VERSION "host-sim"
+#define QMK_BUILDDATE "host-sim"
@@ -0,0 +1,1090 @@
+/*
+ * A small, simplified model of the QMK core, just enough to drive keymap.c
+ * on the host: layers, one-shot state, tap dance, leader, UCIS, unicode
+ * input and HID reports, all on a virtual millisecond clock.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "qmk-sim.h"
+#include "ergodox.h"
+
+sim_stats_t sim_stats;
+sim_prof_t sim_prof[SIM_PROF_FNS];
+uint32_t sim_now;
+bool sim_verbose;
+bool sim_profile;
+FILE *sim_output;
+
+/* Profiling: the host time spent in the keymap's entry points */
+
+static uint64_t sim_clock_ns (void) {
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#define SIM_PROFILE(fn, call) ({                                        \
+      uint64_t __start = sim_profile ? sim_clock_ns () : 0;             \
+      __auto_type __result = (call);                                    \
+      if (sim_profile) {                                                \
+        sim_prof[fn].calls++;                                           \
+        sim_prof[fn].ns += sim_clock_ns () - __start;                   \
+      }                                                                 \
+      __result;                                                         \
+    })
+
+static const macro_t *get_macro (keyrecord_t *record, uint8_t id) {
+  return SIM_PROFILE (SIM_PROF_MACRO, action_get_macro (record, id, 0));
+}
+
+/* Timers */
+
+uint16_t timer_read (void) {
+  return (uint16_t)sim_now;
+}
+
+uint32_t timer_read32 (void) {
+  return sim_now;
+}
+
+uint16_t timer_elapsed (uint16_t last) {
+  return (uint16_t)(timer_read () - last);
+}
+
+uint32_t timer_elapsed32 (uint32_t last) {
+  return sim_now - last;
+}
+
+void wait_ms (uint16_t ms) {
+  sim_stats.wait_calls++;
+  sim_stats.wait_ms += ms;
+  sim_now += ms;
+}
+
+/* Console */
+
+int uprintf (const char *fmt, ...) {
+  char buf[256];
+  va_list ap;
+  int n;
+
+  va_start (ap, fmt);
+  n = vsnprintf (buf, sizeof (buf), fmt, ap);
+  va_end (ap);
+
+  sim_stats.console_bytes += n;
+  sim_stats.console_lines++;
+  if (sim_verbose)
+    fprintf (stderr, "[%8u] console: %s", sim_now, buf);
+  return n;
+}
+
+/* Raw HID */
+
+void raw_hid_send (uint8_t *data, uint8_t length) {
+  sim_stats.raw_reports++;
+  if (sim_verbose) {
+    fprintf (stderr, "[%8u] raw:", sim_now);
+    for (uint8_t i = 0; i < length; i++)
+      fprintf (stderr, " %02x", data[i]);
+    fprintf (stderr, "\n");
+  }
+}
+
+/* Virtual serial: the steno protocols, decoded back into strokes */
+
+// The keys of a stroke, in steno order; ones on the right after a '-' when
+// there are no vowels or '*' to tell the sides apart.
+static const char steno_order[] = "#STKPWHRAO*EUFRPBLGTSDZ";
+#define STENO_VOWELS_FIRST 8
+#define STENO_RIGHT_FIRST 13
+
+static uint32_t steno_stroke;
+static uint8_t steno_packet_bytes;
+
+static void steno_emit (void) {
+  char buf[sizeof (steno_order) + 1], *p = buf;
+  bool middle = steno_stroke & (((1UL << STENO_RIGHT_FIRST) - 1) & ~((1UL << STENO_VOWELS_FIRST) - 1));
+
+  for (uint8_t i = 0; steno_order[i]; i++) {
+    if (i == STENO_RIGHT_FIRST && !middle && (steno_stroke >> STENO_RIGHT_FIRST))
+      *p++ = '-';
+    if (steno_stroke & (1UL << i))
+      *p++ = steno_order[i];
+  }
+  *p = 0;
+
+  sim_stats.steno_strokes++;
+  if (sim_verbose)
+    fprintf (stderr, "[%8u] steno: %s\n", sim_now, buf);
+  if (sim_output)
+    fprintf (sim_output, "{%s}", buf);
+
+  steno_stroke = 0;
+  steno_packet_bytes = 0;
+}
+
+#if defined(STENO_GEMINI)
+// The index of each GeminiPR key in steno_order, -1 for the ones Plover
+// ignores (Fn, the reserved and the power keys).
+static const int8_t gemini_keys[42] = {
+  -1, 0, 0, 0, 0, 0, 0,         // Fn #1-#6
+  1, 1, 2, 3, 4, 5, 6,          // S1- S2- T- K- P- W- H-
+  7, 8, 9, 10, 10, -1, -1,      // R- A- O- *1 *2 res1 res2
+  -1, 10, 10, 11, 12, 13, 14,   // pwr *3 *4 -E -U -F -R
+  15, 16, 17, 18, 19, 20, 21,   // -P -B -L -G -T -S -D
+  0, 0, 0, 0, 0, 0, 22,         // #7-#C -Z
+};
+
+static void steno_decode (uint8_t byte) {
+  // The first byte of a packet, and only that, has the top bit set
+  if (!!(byte & 0x80) != (steno_packet_bytes == 0)) {
+    sim_stats.steno_errors++;
+    steno_stroke = 0;
+    steno_packet_bytes = 0;
+    if (!(byte & 0x80))
+      return;
+  }
+
+  for (uint8_t bit = 0; bit < 7; bit++) {
+    int8_t key = gemini_keys[steno_packet_bytes * 7 + bit];
+
+    if ((byte & (0x40 >> bit)) && key >= 0)
+      steno_stroke |= 1UL << key;
+  }
+  if (++steno_packet_bytes == 6)
+    steno_emit ();
+}
+#else
+// TX Bolt: four groups of six keys, in steno order after the '#', which
+// comes last.
+static int8_t txbolt_group = -1;
+
+static void steno_decode (uint8_t byte) {
+  uint8_t group = byte >> 6;
+
+  // A zero byte, or a group not after the previous one, ends the stroke
+  if (!byte || (int8_t)group <= txbolt_group) {
+    if (steno_packet_bytes)
+      steno_emit ();
+    else if (!byte)
+      sim_stats.steno_errors++;
+    txbolt_group = -1;
+    if (!byte)
+      return;
+  }
+
+  for (uint8_t bit = 0; bit < 6; bit++)
+    if (byte & (1 << bit))
+      steno_stroke |= 1UL << ((group * 6 + bit + 1) % 23);
+  txbolt_group = group;
+  steno_packet_bytes++;
+}
+#endif
+
+void virtser_send (const uint8_t byte) {
+  sim_stats.serial_bytes++;
+  if (sim_verbose)
+    fprintf (stderr, "[%8u] serial: %02x\n", sim_now, byte);
+  steno_decode (byte);
+}
+
+/* LEDs */
+
+static uint8_t led_on;
+static uint8_t led_brightness[3];
+
+static void led_write (uint8_t led, int on, int brightness) {
+  uint8_t old_on = led_on, old_brightness = led_brightness[led];
+
+  sim_stats.led_writes++;
+
+  if (on == 1)
+    led_on |= (1 << led);
+  else if (on == 0)
+    led_on &= ~(1 << led);
+  if (brightness >= 0)
+    led_brightness[led] = brightness;
+
+  if (sim_verbose && (old_on != led_on || old_brightness != led_brightness[led]))
+    fprintf (stderr, "[%8u] leds: %c%c%c %3u %3u %3u\n", sim_now,
+             (led_on & 1) ? '1' : '-', (led_on & 2) ? '2' : '-', (led_on & 4) ? '3' : '-',
+             led_brightness[0], led_brightness[1], led_brightness[2]);
+}
+
+void ergodox_right_led_1_on (void) { led_write (0, 1, -1); }
+void ergodox_right_led_2_on (void) { led_write (1, 1, -1); }
+void ergodox_right_led_3_on (void) { led_write (2, 1, -1); }
+void ergodox_right_led_1_off (void) { led_write (0, 0, -1); }
+void ergodox_right_led_2_off (void) { led_write (1, 0, -1); }
+void ergodox_right_led_3_off (void) { led_write (2, 0, -1); }
+void ergodox_right_led_1_set (uint8_t n) { led_write (0, -1, n); }
+void ergodox_right_led_2_set (uint8_t n) { led_write (1, -1, n); }
+void ergodox_right_led_3_set (uint8_t n) { led_write (2, -1, n); }
+
+void ergodox_led_all_on (void) {
+  ergodox_right_led_1_on ();
+  ergodox_right_led_2_on ();
+  ergodox_right_led_3_on ();
+}
+
+void ergodox_led_all_off (void) {
+  ergodox_right_led_1_off ();
+  ergodox_right_led_2_off ();
+  ergodox_right_led_3_off ();
+}
+
+void ergodox_led_all_set (uint8_t n) {
+  ergodox_right_led_1_set (n);
+  ergodox_right_led_2_set (n);
+  ergodox_right_led_3_set (n);
+}
+
+/* EEPROM */
+
+static bool ee_enabled;
+static uint8_t ee_default_layer;
+
+bool eeconfig_is_enabled (void) {
+  return ee_enabled;
+}
+
+void eeconfig_init (void) {
+  ee_enabled = true;
+  ee_default_layer = 1;
+}
+
+uint8_t eeconfig_read_default_layer (void) {
+  return ee_default_layer;
+}
+
+void eeconfig_update_default_layer (uint8_t val) {
+  ee_default_layer = val;
+}
+
+/* Layers */
+
+uint32_t layer_state;
+uint32_t default_layer_state;
+
+uint8_t biton32 (uint32_t bits) {
+  uint8_t n = 0;
+
+  while (bits >>= 1)
+    n++;
+  return n;
+}
+
+void layer_on (uint8_t layer) {
+  layer_state |= (1UL << layer);
+}
+
+void layer_off (uint8_t layer) {
+  layer_state &= ~(1UL << layer);
+}
+
+void layer_invert (uint8_t layer) {
+  layer_state ^= (1UL << layer);
+}
+
+void layer_clear (void) {
+  layer_state = 0;
+}
+
+void default_layer_set (uint32_t state) {
+  default_layer_state = state;
+}
+
+void default_layer_and (uint32_t state) {
+  default_layer_state &= state;
+}
+
+void default_layer_or (uint32_t state) {
+  default_layer_state |= state;
+}
+
+/* Reports */
+
+static report_keyboard_t report;
+report_keyboard_t *keyboard_report = &report;
+
+static uint8_t oneshot_mods;
+static uint16_t oneshot_time;
+static uint8_t oneshot_layer;
+static uint8_t oneshot_layer_state;
+static bool oneshot_layer_set;
+
+void set_oneshot_mods (uint8_t mods) {
+  oneshot_mods = mods;
+  oneshot_time = timer_read ();
+}
+
+uint8_t get_oneshot_mods (void) {
+  return oneshot_mods;
+}
+
+void clear_oneshot_mods (void) {
+  oneshot_mods = 0;
+}
+
+bool has_oneshot_mods_timed_out (void) {
+#ifdef ONESHOT_TIMEOUT
+  return timer_elapsed (oneshot_time) >= ONESHOT_TIMEOUT;
+#else
+  return false;
+#endif
+}
+
+void set_oneshot_layer (uint8_t layer, uint8_t state) {
+  oneshot_layer = layer;
+  oneshot_layer_state = state;
+  oneshot_layer_set = true;
+  layer_on (layer);
+}
+
+void clear_oneshot_layer_state (uint8_t state) {
+  uint8_t start = oneshot_layer_state;
+
+  oneshot_layer_state &= ~state;
+  if (!oneshot_layer_state && start)
+    layer_off (oneshot_layer);
+}
+
+/* What the host would type, for comparing the keymap's output across runs */
+
+static void host_type (uint8_t mods, uint8_t code) {
+  static const char lower[] = "abcdefghijklmnopqrstuvwxyz1234567890\n\e\b\t -=[]\\#;'`,./";
+  static const char upper[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ!@#$%^&*()\n\e\b\t _+{}|~:\"~<>?";
+  bool shift = mods & (MOD_BIT (KC_LSFT) | MOD_BIT (KC_RSFT));
+
+  if (!sim_output)
+    return;
+
+  if (code >= KC_A && code <= KC_SLSH && !(mods & ~(MOD_BIT (KC_LSFT) | MOD_BIT (KC_RSFT))))
+    fputc ((shift ? upper : lower)[code - KC_A], sim_output);
+  else
+    fprintf (sim_output, "<%02x:%02x>", mods, code);
+}
+
+static bool report_has_keys (void) {
+  for (uint8_t i = 0; i < sizeof (report.keys); i++)
+    if (report.keys[i])
+      return true;
+  return false;
+}
+
+void send_keyboard_report (void) {
+  static uint8_t last_keys[sizeof (report.keys)];
+  uint8_t mods = report.mods;
+
+  if (oneshot_mods && !has_oneshot_mods_timed_out ()) {
+    mods |= oneshot_mods;
+    if (report_has_keys ())
+      clear_oneshot_mods ();
+  }
+
+  sim_stats.reports++;
+  if (sim_verbose) {
+    fprintf (stderr, "[%8u] report: mods=%02x keys=", sim_now, mods);
+    for (uint8_t i = 0; i < sizeof (report.keys); i++)
+      if (report.keys[i])
+        fprintf (stderr, "%02x ", report.keys[i]);
+    fprintf (stderr, "\n");
+  }
+
+  for (uint8_t i = 0; i < sizeof (report.keys); i++)
+    if (report.keys[i] && !memchr (last_keys, report.keys[i], sizeof (last_keys)))
+      host_type (mods, report.keys[i]);
+  memcpy (last_keys, report.keys, sizeof (last_keys));
+}
+
+static void host_consumer_send (uint8_t code) {
+  sim_stats.reports++;
+  if (sim_verbose)
+    fprintf (stderr, "[%8u] consumer: %02x\n", sim_now, code);
+  if (sim_output && code)
+    fprintf (sim_output, "<cc:%02x>", code);
+}
+
+void register_code (uint8_t code) {
+  if (code == KC_NO || code == KC_TRNS)
+    return;
+
+  if (IS_MOD (code)) {
+    report.mods |= MOD_BIT (code);
+    send_keyboard_report ();
+    return;
+  }
+
+  if (IS_CONSUMER (code)) {
+    host_consumer_send (code);
+    return;
+  }
+
+  for (uint8_t i = 0; i < sizeof (report.keys); i++)
+    if (report.keys[i] == code)
+      return;
+  for (uint8_t i = 0; i < sizeof (report.keys); i++) {
+    if (!report.keys[i]) {
+      report.keys[i] = code;
+      break;
+    }
+  }
+  send_keyboard_report ();
+}
+
+void unregister_code (uint8_t code) {
+  if (code == KC_NO || code == KC_TRNS)
+    return;
+
+  if (IS_MOD (code)) {
+    report.mods &= ~MOD_BIT (code);
+    send_keyboard_report ();
+    return;
+  }
+
+  if (IS_CONSUMER (code)) {
+    host_consumer_send (0);
+    return;
+  }
+
+  for (uint8_t i = 0; i < sizeof (report.keys); i++) {
+    if (report.keys[i] == code) {
+      report.keys[i] = 0;
+      send_keyboard_report ();
+      return;
+    }
+  }
+}
+
+uint8_t get_mods (void) {
+  return report.mods;
+}
+
+void add_mods (uint8_t mods) {
+  report.mods |= mods;
+}
+
+void del_mods (uint8_t mods) {
+  report.mods &= ~mods;
+}
+
+void set_mods (uint8_t mods) {
+  report.mods = mods;
+}
+
+void clear_mods (void) {
+  report.mods = 0;
+}
+
+void add_key (uint8_t key) {
+  for (uint8_t i = 0; i < sizeof (report.keys); i++)
+    if (report.keys[i] == key)
+      return;
+  for (uint8_t i = 0; i < sizeof (report.keys); i++) {
+    if (!report.keys[i]) {
+      report.keys[i] = key;
+      return;
+    }
+  }
+}
+
+void del_key (uint8_t key) {
+  for (uint8_t i = 0; i < sizeof (report.keys); i++)
+    if (report.keys[i] == key)
+      report.keys[i] = 0;
+}
+
+void clear_keys (void) {
+  memset (report.keys, 0, sizeof (report.keys));
+}
+
+static void do_code16 (uint16_t code, void (*f) (uint8_t)) {
+  if (code < QK_MODS || code > QK_MODS_MAX)
+    return;
+
+  if (code & QK_RMODS_MIN) {
+    if (code & (QK_RCTL & 0x0F00)) f (KC_RCTL);
+    if (code & (QK_RSFT & 0x0F00)) f (KC_RSFT);
+    if (code & (QK_RALT & 0x0F00)) f (KC_RALT);
+    if (code & (QK_RGUI & 0x0F00)) f (KC_RGUI);
+  } else {
+    if (code & QK_LCTL) f (KC_LCTL);
+    if (code & QK_LSFT) f (KC_LSFT);
+    if (code & QK_LALT) f (KC_LALT);
+    if (code & QK_LGUI) f (KC_LGUI);
+  }
+}
+
+void register_code16 (uint16_t code) {
+  do_code16 (code, register_code);
+  register_code (code);
+}
+
+void unregister_code16 (uint16_t code) {
+  unregister_code (code);
+  do_code16 (code, unregister_code);
+}
+
+void reset_keyboard (void) {
+  sim_stats.resets++;
+}
+
+/* Macros */
+
+void action_macro_play (const macro_t *macro_p) {
+  macro_t interval = 0;
+
+  if (!macro_p)
+    return;
+
+  while (true) {
+    switch (pgm_read_byte (macro_p++)) {
+    case KEY_DOWN:
+      register_code (pgm_read_byte (macro_p++));
+      break;
+    case KEY_UP:
+      unregister_code (pgm_read_byte (macro_p++));
+      break;
+    case WAIT:
+      wait_ms (pgm_read_byte (macro_p++));
+      break;
+    case INTERVAL:
+      interval = pgm_read_byte (macro_p++);
+      break;
+    default:
+      return;
+    }
+    if (interval)
+      wait_ms (interval);
+  }
+}
+
+/* Unicode */
+
+static uint8_t input_mode;
+
+void set_unicode_input_mode (uint8_t os_target) {
+  input_mode = os_target;
+}
+
+void unicode_input_start (void) {
+  register_code (KC_LCTL);
+  register_code (KC_LSFT);
+  register_code (KC_U);
+  unregister_code (KC_U);
+  unregister_code (KC_LSFT);
+  unregister_code (KC_LCTL);
+  wait_ms (UNICODE_TYPE_DELAY);
+}
+
+void unicode_input_finish (void) {
+  register_code (KC_SPC);
+  unregister_code (KC_SPC);
+}
+
+static uint8_t hex_to_keycode (uint8_t hex) {
+  if (hex == 0)
+    return KC_0;
+  if (hex < 0xA)
+    return KC_1 + (hex - 0x1);
+  return KC_A + (hex - 0xA);
+}
+
+void register_hex (uint16_t hex) {
+  for (int i = 3; i >= 0; i--) {
+    uint8_t digit = ((hex >> (i * 4)) & 0xF);
+
+    register_code (hex_to_keycode (digit));
+    unregister_code (hex_to_keycode (digit));
+  }
+}
+
+/* UCIS */
+
+#ifdef UCIS_ENABLE
+
+qk_ucis_state_t qk_ucis_state;
+
+void qk_ucis_start (void) {
+  qk_ucis_state.count = 0;
+  qk_ucis_state.in_progress = true;
+
+  qk_ucis_start_user ();
+}
+
+__attribute__((weak))
+void qk_ucis_start_user (void) {
+  unicode_input_start ();
+  register_hex (0x2328);
+  unicode_input_finish ();
+}
+
+static bool is_uni_seq (char *seq) {
+  uint8_t i;
+
+  for (i = 0; seq[i]; i++) {
+    uint16_t code;
+
+    if (('1' <= seq[i]) && (seq[i] <= '9'))
+      code = seq[i] - '1' + KC_1;
+    else if (seq[i] == '0')
+      code = KC_0;
+    else
+      code = seq[i] - 'a' + KC_A;
+
+    if (i > qk_ucis_state.count || qk_ucis_state.codes[i] != code)
+      return false;
+  }
+
+  return (qk_ucis_state.codes[i] == KC_ENT ||
+          qk_ucis_state.codes[i] == KC_SPC);
+}
+
+__attribute__((weak))
+void qk_ucis_symbol_fallback (void) {
+  for (uint8_t i = 0; i < qk_ucis_state.count - 1; i++) {
+    uint8_t code = qk_ucis_state.codes[i];
+
+    register_code (code);
+    unregister_code (code);
+    wait_ms (UNICODE_TYPE_DELAY);
+  }
+}
+
+void register_ucis (const char *hex) {
+  for (int i = 0; hex[i]; i++) {
+    uint8_t kc = 0;
+    char c = hex[i];
+
+    switch (c) {
+    case '0':
+      kc = KC_0;
+      break;
+    case '1' ... '9':
+      kc = c - '1' + KC_1;
+      break;
+    case 'a' ... 'f':
+      kc = c - 'a' + KC_A;
+      break;
+    case 'A' ... 'F':
+      kc = c - 'A' + KC_A;
+      break;
+    }
+
+    if (kc) {
+      register_code (kc);
+      unregister_code (kc);
+      wait_ms (UNICODE_TYPE_DELAY);
+    }
+  }
+}
+
+static bool process_ucis (uint16_t keycode, keyrecord_t *record) {
+  uint8_t i;
+
+  if (!qk_ucis_state.in_progress)
+    return true;
+
+  if (qk_ucis_state.count >= UCIS_MAX_SYMBOL_LENGTH - 1 &&
+      !(keycode == KC_BSPC || keycode == KC_ESC || keycode == KC_SPC || keycode == KC_ENT))
+    return false;
+
+  if (!record->event.pressed)
+    return true;
+
+  qk_ucis_state.codes[qk_ucis_state.count] = keycode;
+  qk_ucis_state.count++;
+
+  if (keycode == KC_BSPC) {
+    if (qk_ucis_state.count >= 2) {
+      qk_ucis_state.count -= 2;
+      return true;
+    } else {
+      qk_ucis_state.count--;
+      return false;
+    }
+  }
+
+  if (keycode == KC_ENT || keycode == KC_SPC || keycode == KC_ESC) {
+    bool symbol_found = false;
+
+    for (i = qk_ucis_state.count; i > 0; i--) {
+      register_code (KC_BSPC);
+      unregister_code (KC_BSPC);
+      wait_ms (UNICODE_TYPE_DELAY);
+    }
+
+    if (keycode == KC_ESC) {
+      qk_ucis_state.in_progress = false;
+      return false;
+    }
+
+    unicode_input_start ();
+    for (i = 0; ucis_symbol_table[i].symbol; i++) {
+      if (is_uni_seq (ucis_symbol_table[i].symbol)) {
+        symbol_found = true;
+        register_ucis (ucis_symbol_table[i].code + 2);
+        break;
+      }
+    }
+    if (!symbol_found)
+      qk_ucis_symbol_fallback ();
+    unicode_input_finish ();
+
+    qk_ucis_state.in_progress = false;
+    return false;
+  }
+  return true;
+}
+#else
+static bool process_ucis (uint16_t keycode, keyrecord_t *record) {
+  return true;
+}
+#endif
+
+/* send_string */
+
+static const char shifted_ascii[] = "~!@#$%^&*()_+{}|:\"<>?";
+static const char unshifted_ascii[] = "`1234567890-=[]\\;',./";
+
+static void ascii_to_keycode (char c, uint8_t *kc, bool *shift) {
+  const char *p;
+
+  *shift = false;
+  *kc = KC_NO;
+
+  if (c >= 'a' && c <= 'z') {
+    *kc = KC_A + (c - 'a');
+  } else if (c >= 'A' && c <= 'Z') {
+    *kc = KC_A + (c - 'A');
+    *shift = true;
+  } else if (c >= '1' && c <= '9') {
+    *kc = KC_1 + (c - '1');
+  } else if (c == '0') {
+    *kc = KC_0;
+  } else if (c == ' ') {
+    *kc = KC_SPC;
+  } else if (c == '\n') {
+    *kc = KC_ENT;
+  } else if (c == '\t') {
+    *kc = KC_TAB;
+  } else if ((p = strchr (shifted_ascii, c))) {
+    ascii_to_keycode (unshifted_ascii[p - shifted_ascii], kc, shift);
+    *shift = true;
+  } else {
+    static const uint8_t codes[] = {
+      KC_GRV, KC_MINS, KC_EQL, KC_LBRC, KC_RBRC, KC_BSLS, KC_SCLN, KC_QUOT,
+      KC_COMM, KC_DOT, KC_SLSH
+    };
+    static const char chars[] = "`-=[]\\;',./";
+
+    if ((p = strchr (chars, c)))
+      *kc = codes[p - chars];
+  }
+}
+
+void send_string (const char *str) {
+  for (; *str; str++) {
+    uint8_t kc;
+    bool shift;
+
+    ascii_to_keycode (*str, &kc, &shift);
+    if (shift)
+      register_code (KC_LSFT);
+    register_code (kc);
+    unregister_code (kc);
+    if (shift)
+      unregister_code (KC_LSFT);
+  }
+}
+
+/* Tap dance */
+
+static int16_t highest_td = -1;
+static uint16_t last_td;
+
+static void process_tap_dance_action_on_each_tap (qk_tap_dance_action_t *action) {
+  if (action->fn.on_each_tap)
+    action->fn.on_each_tap (&action->state, action->user_data);
+}
+
+static void process_tap_dance_action_on_dance_finished (qk_tap_dance_action_t *action) {
+  if (action->state.finished)
+    return;
+  action->state.finished = true;
+  if (action->fn.on_dance_finished)
+    action->fn.on_dance_finished (&action->state, action->user_data);
+}
+
+static void process_tap_dance_action_on_reset (qk_tap_dance_action_t *action) {
+  if (action->fn.on_reset)
+    action->fn.on_reset (&action->state, action->user_data);
+}
+
+void reset_tap_dance (qk_tap_dance_state_t *state) {
+  qk_tap_dance_action_t *action;
+
+  if (state->pressed)
+    return;
+
+  action = &tap_dance_actions[state->keycode - QK_TAP_DANCE];
+  process_tap_dance_action_on_reset (action);
+
+  state->count = 0;
+  state->interrupted = false;
+  state->finished = false;
+  last_td = 0;
+}
+
+void qk_tap_dance_pair_finished (qk_tap_dance_state_t *state, void *user_data) {
+  qk_tap_dance_pair_t *pair = (qk_tap_dance_pair_t *)user_data;
+
+  if (state->count == 1)
+    register_code16 (pair->kc1);
+  else if (state->count == 2)
+    register_code16 (pair->kc2);
+}
+
+void qk_tap_dance_pair_reset (qk_tap_dance_state_t *state, void *user_data) {
+  qk_tap_dance_pair_t *pair = (qk_tap_dance_pair_t *)user_data;
+
+  if (state->count == 1)
+    unregister_code16 (pair->kc1);
+  else if (state->count == 2)
+    unregister_code16 (pair->kc2);
+}
+
+static bool process_tap_dance (uint16_t keycode, keyrecord_t *record) {
+  qk_tap_dance_action_t *action;
+
+  if (keycode >= QK_TAP_DANCE && keycode <= QK_TAP_DANCE_MAX) {
+    uint16_t idx = keycode - QK_TAP_DANCE;
+
+    if ((int16_t)idx > highest_td)
+      highest_td = idx;
+    action = &tap_dance_actions[idx];
+
+    action->state.pressed = record->event.pressed;
+    if (record->event.pressed) {
+      action->state.keycode = keycode;
+      action->state.count++;
+      action->state.timer = timer_read ();
+      action->state.oneshot_mods = get_oneshot_mods ();
+      process_tap_dance_action_on_each_tap (action);
+
+      if (last_td && last_td != keycode) {
+        qk_tap_dance_action_t *paction = &tap_dance_actions[last_td - QK_TAP_DANCE];
+
+        paction->state.interrupted = true;
+        process_tap_dance_action_on_dance_finished (paction);
+        reset_tap_dance (&paction->state);
+      }
+      last_td = keycode;
+    } else if (action->state.finished) {
+      reset_tap_dance (&action->state);
+    }
+    return false;
+  }
+
+  if (!record->event.pressed || highest_td == -1)
+    return true;
+
+  for (int i = 0; i <= highest_td; i++) {
+    action = &tap_dance_actions[i];
+    if (action->state.count == 0)
+      continue;
+    action->state.interrupted = true;
+    process_tap_dance_action_on_dance_finished (action);
+    reset_tap_dance (&action->state);
+  }
+  return true;
+}
+
+static void matrix_scan_tap_dance (void) {
+  for (int i = 0; i <= highest_td; i++) {
+    qk_tap_dance_action_t *action = &tap_dance_actions[i];
+
+    if (action->state.count && timer_elapsed (action->state.timer) > TAPPING_TERM) {
+      process_tap_dance_action_on_dance_finished (action);
+      reset_tap_dance (&action->state);
+    }
+  }
+}
+
+/* Leader */
+
+bool leading;
+uint16_t leader_time;
+uint16_t leader_sequence[5];
+uint8_t leader_sequence_size;
+
+__attribute__((weak))
+void leader_start (void) {}
+
+__attribute__((weak))
+void leader_end (void) {}
+
+static bool process_leader (uint16_t keycode, keyrecord_t *record) {
+  if (!record->event.pressed)
+    return true;
+
+  if (!leading && keycode == KC_LEAD) {
+    leader_start ();
+    leading = true;
+    leader_time = timer_read ();
+    leader_sequence_size = 0;
+    memset (leader_sequence, 0, sizeof (leader_sequence));
+    return false;
+  }
+
+  if (leading && timer_elapsed (leader_time) < LEADER_TIMEOUT) {
+    if (leader_sequence_size < 5)
+      leader_sequence[leader_sequence_size++] = keycode;
+    return false;
+  }
+  return true;
+}
+
+/* Action processing */
+
+static uint16_t pressed_keycode[MATRIX_ROWS][MATRIX_COLS];
+static keypos_t last_tap_key;
+static uint16_t last_tap_time;
+static uint8_t tap_count;
+static bool other_key_since_mod;
+static uint8_t locked_mods;
+
+static uint16_t keymap_key_to_keycode (uint8_t row, uint8_t col) {
+  uint32_t layers = layer_state | default_layer_state;
+
+  for (int8_t l = 31; l >= 0; l--) {
+    uint16_t kc;
+
+    if (!(layers & (1UL << l)))
+      continue;
+    kc = pgm_read_word (&keymaps[l][row][col]);
+    if (kc != KC_TRNS)
+      return kc;
+  }
+  return KC_NO;
+}
+
+static void process_function (uint16_t action, keyrecord_t *record) {
+  switch (action & 0xFF00) {
+  case ACT_LAYER_CLEAR:
+    if (record->event.pressed)
+      layer_clear ();
+    break;
+  case ACT_LAYER_INVERT:
+    if (record->event.pressed)
+      layer_invert (action & 0xFF);
+    break;
+  case ACT_MACRO_TAP:
+    action_macro_play (get_macro (record, action & 0xFF));
+    break;
+  default:
+    if ((action & 0xF000) == ACT_MODS_ONESHOT) {
+      uint8_t mods = action & 0xFF;
+
+      if (record->event.pressed) {
+        other_key_since_mod = false;
+        report.mods |= mods;
+        send_keyboard_report ();
+        break;
+      }
+
+      report.mods &= ~mods;
+      if (locked_mods & mods) {
+        locked_mods &= ~mods;
+      } else if (!other_key_since_mod) {
+        if (record->tap.count >= ONESHOT_TAP_TOGGLE) {
+          locked_mods |= mods;
+          clear_oneshot_mods ();
+        } else {
+          set_oneshot_mods (mods);
+        }
+      }
+      report.mods |= locked_mods;
+      send_keyboard_report ();
+    }
+    break;
+  }
+}
+
+static void process_action (uint16_t keycode, keyrecord_t *record) {
+  bool pressed = record->event.pressed;
+
+  if (keycode <= 0xFF || (keycode >= QK_MODS && keycode <= QK_MODS_MAX)) {
+    if (pressed)
+      register_code16 (keycode);
+    else
+      unregister_code16 (keycode);
+  } else if (keycode >= QK_FUNCTION && keycode <= QK_FUNCTION_MAX) {
+    process_function (pgm_read_word (&fn_actions[keycode & 0xFFF]), record);
+  } else if (keycode >= QK_MACRO && keycode <= QK_MACRO_MAX) {
+    action_macro_play (get_macro (record, keycode & 0xFF));
+  } else if (keycode >= QK_ONE_SHOT_LAYER && keycode <= QK_ONE_SHOT_LAYER_MAX) {
+    if (pressed)
+      set_oneshot_layer (keycode & 0xFF, ONESHOT_START);
+    else
+      clear_oneshot_layer_state (ONESHOT_PRESSED);
+  }
+}
+
+uint16_t sim_key_event (uint8_t row, uint8_t col, bool pressed) {
+  keyrecord_t record = { .event = { .key = { .col = col, .row = row },
+                                    .pressed = pressed,
+                                    .time = timer_read () } };
+  uint16_t keycode;
+
+  sim_stats.events++;
+
+  if (pressed) {
+    keycode = keymap_key_to_keycode (row, col);
+    pressed_keycode[row][col] = keycode;
+
+    if (last_tap_key.row == row && last_tap_key.col == col &&
+        timer_elapsed (last_tap_time) < TAPPING_TERM)
+      tap_count = tap_count < 15 ? tap_count + 1 : 15;
+    else
+      tap_count = 1;
+    last_tap_key = record.event.key;
+    last_tap_time = timer_read ();
+    other_key_since_mod = true;
+    oneshot_layer_set = false;
+  } else {
+    keycode = pressed_keycode[row][col];
+  }
+  record.tap.count = (last_tap_key.row == row && last_tap_key.col == col) ? tap_count : 0;
+
+  if (SIM_PROFILE (SIM_PROF_RECORD, process_record_user (keycode, &record)) &&
+      process_tap_dance (keycode, &record) &&
+      process_leader (keycode, &record) &&
+      process_ucis (keycode, &record))
+    process_action (keycode, &record);
+
+  if (pressed && !oneshot_layer_set && (oneshot_layer_state & ONESHOT_OTHER_KEY_PRESSED) &&
+      !(keycode >= QK_ONE_SHOT_LAYER && keycode <= QK_ONE_SHOT_LAYER_MAX))
+    clear_oneshot_layer_state (ONESHOT_OTHER_KEY_PRESSED);
+
+  return keycode;
+}
+
+void sim_scan (void) {
+  sim_stats.scans++;
+  matrix_scan_tap_dance ();
+  SIM_PROFILE (SIM_PROF_SCAN, (matrix_scan_user (), 0));
+}
+
+void sim_init (uint8_t default_layer) {
+  eeconfig_init ();
+  eeconfig_update_default_layer (1UL << default_layer);
+  default_layer_set (eeconfig_read_default_layer ());
+  matrix_init_user ();
+}
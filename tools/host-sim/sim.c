@@ -0,0 +1,352 @@
+/*
+ * keymap-sim: replay recorded key-event traces through keymap.c on the host.
+ *
+ * Traces are keylogger output, either raw ("KL: col=..., row=..., ...") or
+ * as found in the heatmap tool's stamped-log, with an optional timestamp in
+ * front, or batches of binary records ("KB:...") with the device's own
+ * timestamps. A few directives make hand-written traces easier:
+ *
+ *   # comment
+ *   wait <ms>          - let time pass without any key events
+ *   down <col> <row>   - press a key
+ *   up <col> <row>     - release a key
+ *   tap <col> <row>    - press and release a key
+ *
+ * Lines without a timestamp are spaced by the --gap interval.
+ *
+ * With --key-reports, the HID reports sent between an event and the next
+ * one are counted against the key of the event, and a table of reports per
+ * key press is printed at the end, to compare what typing each key costs.
+ *
+ * With --profile, the host time spent in matrix_scan_user(),
+ * process_record_user() and action_get_macro() is measured, and printed
+ * along with the number of scans per (virtual) second.
+ *
+ * When the keymap is built with STENO_PROTOCOL=gemini or txbolt, the
+ * packets it sends on the virtual serial port are decoded, and the strokes
+ * written to the output as {STROKE}.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "qmk-sim.h"
+
+#define ADORE_LAYER 1
+
+typedef struct {
+  uint32_t time;
+  uint8_t  row;
+  uint8_t  col;
+  bool     pressed;
+} sim_event_t;
+
+typedef struct {
+  uint16_t keycode;
+  uint64_t presses;
+  uint64_t reports;
+} sim_key_stats_t;
+
+typedef struct {
+  sim_event_t *events;
+  size_t       count;
+  size_t       size;
+  uint32_t     end;
+  int8_t       default_layer;
+} sim_trace_t;
+
+static void trace_push (sim_trace_t *trace, uint32_t time, unsigned col, unsigned row,
+                        bool pressed) {
+  if (row >= MATRIX_ROWS || col >= MATRIX_COLS)
+    return;
+
+  if (trace->count == trace->size) {
+    trace->size = trace->size ? trace->size * 2 : 1024;
+    trace->events = realloc (trace->events, trace->size * sizeof (sim_event_t));
+    if (!trace->events) {
+      perror ("realloc");
+      exit (1);
+    }
+  }
+  trace->events[trace->count++] = (sim_event_t) { time, row, col, pressed };
+}
+
+static int trace_load (sim_trace_t *trace, const char *fn, uint32_t gap) {
+  FILE *f = strcmp (fn, "-") ? fopen (fn, "r") : stdin;
+  char *line = NULL;
+  size_t len = 0;
+  uint32_t now = trace->end;
+  double first_stamp = -1;
+  uint32_t stamp_base = now;
+  bool have_device_time = false;
+  uint32_t first_device_time = 0;
+
+  if (!f) {
+    perror (fn);
+    return -1;
+  }
+
+  while (getline (&line, &len, f) != -1) {
+    char *kl = strstr (line, "KL:");
+    char *kb = strstr (line, "KB:");
+    unsigned col, row, pressed, arg;
+    char layer[16];
+
+    if (kb && strlen (kb) > 8) {
+      for (char *p = kb + 8; sscanf (p, "%2x%2x%8x", &col, &row, &arg) == 3; p += 12) {
+        if (!have_device_time) {
+          have_device_time = true;
+          first_device_time = arg;
+        }
+        now = stamp_base + (arg - first_device_time);
+
+        if (trace->default_layer < 0)
+          trace->default_layer = row == ADORE_LAYER ? ADORE_LAYER : 0;
+
+        trace_push (trace, now, (col >> 1) & 0x7, col >> 4, col & 1);
+      }
+    } else if (kl) {
+      if (sscanf (kl, "KL: col=%u, row=%u, pressed=%u, layer=%15s", &col, &row,
+                  &pressed, layer) < 3)
+        continue;
+
+      if (kl != line) {
+        double stamp = strtod (line, NULL);
+
+        if (first_stamp < 0)
+          first_stamp = stamp;
+        now = stamp_base + (uint32_t)((stamp - first_stamp) * 1000);
+      } else {
+        now += gap;
+      }
+
+      if (trace->default_layer < 0)
+        trace->default_layer = strcmp (layer, "ADORE") ? 0 : ADORE_LAYER;
+
+      trace_push (trace, now, col, row, pressed);
+    } else if (sscanf (line, "wait %u", &arg) == 1) {
+      now += arg;
+    } else if (sscanf (line, "down %u %u", &col, &row) == 2) {
+      now += gap;
+      trace_push (trace, now, col, row, true);
+    } else if (sscanf (line, "up %u %u", &col, &row) == 2) {
+      now += gap;
+      trace_push (trace, now, col, row, false);
+    } else if (sscanf (line, "tap %u %u", &col, &row) == 2) {
+      now += gap;
+      trace_push (trace, now, col, row, true);
+      now += gap;
+      trace_push (trace, now, col, row, false);
+    }
+  }
+
+  free (line);
+  if (f != stdin)
+    fclose (f);
+  trace->end = now;
+  return 0;
+}
+
+static void scan_until (uint32_t until, uint32_t scan_interval, uint32_t max_idle) {
+  uint32_t idle_start = sim_now;
+
+  while (sim_now < until) {
+    if (sim_now - idle_start >= max_idle) {
+      sim_now = until;
+      break;
+    }
+    sim_scan ();
+    sim_now += scan_interval;
+  }
+}
+
+static void print_key_reports (sim_key_stats_t stats[MATRIX_ROWS][MATRIX_COLS]) {
+  printf ("\nreports per key press:\n");
+  printf ("  col row  keycode  presses  reports  per press\n");
+  for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+      sim_key_stats_t *k = &stats[row][col];
+
+      if (!k->presses)
+        continue;
+      printf ("  %3u %3u   0x%04x %8llu %8llu %10.2f\n", col, row, k->keycode,
+              (unsigned long long)k->presses, (unsigned long long)k->reports,
+              (double)k->reports / (double)k->presses);
+    }
+  }
+}
+
+static void print_profile (double elapsed) {
+  static const char *names[SIM_PROF_FNS] = {
+    "matrix_scan_user", "process_record_user", "action_get_macro"
+  };
+
+  printf ("\nprofile:\n");
+  printf ("  scans/sec:        %.0f (virtual), %.0f (host)\n",
+          sim_now ? sim_stats.scans * 1000.0 / sim_now : 0.0,
+          elapsed > 0 ? sim_stats.scans / elapsed : 0.0);
+  printf ("  function                 calls   total ms   ns/call\n");
+  for (uint8_t fn = 0; fn < SIM_PROF_FNS; fn++)
+    printf ("  %-20s %9llu %10.2f %9.1f\n", names[fn],
+            (unsigned long long)sim_prof[fn].calls, sim_prof[fn].ns / 1e6,
+            sim_prof[fn].calls ? (double)sim_prof[fn].ns / sim_prof[fn].calls : 0.0);
+}
+
+static double now_seconds (void) {
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage (const char *name) {
+  fprintf (stderr,
+           "Usage: %s [options] TRACE...\n"
+           "\n"
+           "  -g, --gap MS           spacing of events without a timestamp (default: 40)\n"
+           "  -s, --scan-interval MS virtual time between two matrix scans (default: 1)\n"
+           "  -i, --max-idle MS      scan at most this long between two events (default: 5000)\n"
+           "  -l, --layer N          default layer, instead of guessing from the trace\n"
+           "  -n, --repeat N         replay the traces N times (default: 1)\n"
+           "  -o, --output FILE      write the text the host would see to FILE\n"
+           "  -p, --profile          print the time spent in the keymap's entry points\n"
+           "  -r, --key-reports      print the number of HID reports per key press\n"
+           "  -v, --verbose          print every HID report and console line\n",
+           name);
+}
+
+int main (int argc, char *argv[]) {
+  static const struct option long_options[] = {
+    { "gap", required_argument, NULL, 'g' },
+    { "scan-interval", required_argument, NULL, 's' },
+    { "max-idle", required_argument, NULL, 'i' },
+    { "layer", required_argument, NULL, 'l' },
+    { "repeat", required_argument, NULL, 'n' },
+    { "output", required_argument, NULL, 'o' },
+    { "profile", no_argument, NULL, 'p' },
+    { "key-reports", no_argument, NULL, 'r' },
+    { "verbose", no_argument, NULL, 'v' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 },
+  };
+  static sim_key_stats_t key_stats[MATRIX_ROWS][MATRIX_COLS];
+  sim_key_stats_t *last_key = NULL;
+  uint64_t last_reports = 0;
+  bool key_reports = false;
+  sim_trace_t trace = { .default_layer = -1 };
+  uint32_t gap = 40, scan_interval = 1, max_idle = 5000;
+  int layer = -1, repeat = 1, opt;
+  double start, elapsed;
+
+  while ((opt = getopt_long (argc, argv, "g:s:i:l:n:o:prvh", long_options, NULL)) != -1) {
+    switch (opt) {
+    case 'g': gap = atoi (optarg); break;
+    case 's': scan_interval = atoi (optarg); break;
+    case 'i': max_idle = atoi (optarg); break;
+    case 'l': layer = atoi (optarg); break;
+    case 'n': repeat = atoi (optarg); break;
+    case 'o':
+      sim_output = strcmp (optarg, "-") ? fopen (optarg, "w") : stdout;
+      if (!sim_output) {
+        perror (optarg);
+        return 1;
+      }
+      break;
+    case 'p': sim_profile = true; break;
+    case 'r': key_reports = true; break;
+    case 'v': sim_verbose = true; break;
+    case 'h':
+      usage (argv[0]);
+      return 0;
+    default:
+      usage (argv[0]);
+      return 1;
+    }
+  }
+
+  if (optind >= argc || scan_interval == 0) {
+    usage (argv[0]);
+    return 1;
+  }
+
+  for (int r = 0; r < repeat; r++) {
+    for (int i = optind; i < argc; i++) {
+      if (trace_load (&trace, argv[i], gap) < 0)
+        return 1;
+      trace.end += max_idle;
+    }
+  }
+
+  if (layer < 0)
+    layer = trace.default_layer < 0 ? 0 : trace.default_layer;
+
+  start = now_seconds ();
+
+  sim_init (layer);
+  for (size_t i = 0; i < trace.count; i++) {
+    sim_event_t *e = &trace.events[i];
+    uint16_t keycode;
+
+    scan_until (e->time, scan_interval, max_idle);
+    if (sim_now > e->time) {
+      sim_stats.delayed_events++;
+      if (sim_now - e->time > sim_stats.delay_ms_max)
+        sim_stats.delay_ms_max = sim_now - e->time;
+    }
+    if (last_key)
+      last_key->reports += sim_stats.reports - last_reports;
+    last_reports = sim_stats.reports;
+    last_key = &key_stats[e->row][e->col];
+
+    keycode = sim_key_event (e->row, e->col, e->pressed);
+    if (e->pressed) {
+      last_key->keycode = keycode;
+      last_key->presses++;
+    }
+    sim_scan ();
+  }
+  scan_until (sim_now + max_idle, scan_interval, max_idle);
+  if (last_key)
+    last_key->reports += sim_stats.reports - last_reports;
+
+  elapsed = now_seconds () - start;
+
+#define PER(a, b) ((b) ? (double)(a) / (double)(b) : 0.0)
+
+  printf ("events:           %llu\n", (unsigned long long)sim_stats.events);
+  printf ("events/sec:       %.0f\n", PER (sim_stats.events, elapsed));
+  printf ("virtual time:     %u ms\n", sim_now);
+  printf ("scans:            %llu\n", (unsigned long long)sim_stats.scans);
+  printf ("HID reports:      %llu (%.2f per event)\n",
+          (unsigned long long)sim_stats.reports, PER (sim_stats.reports, sim_stats.events));
+  printf ("LED writes:       %llu (%.2f per scan)\n",
+          (unsigned long long)sim_stats.led_writes, PER (sim_stats.led_writes, sim_stats.scans));
+  printf ("console output:   %llu bytes in %llu lines\n",
+          (unsigned long long)sim_stats.console_bytes,
+          (unsigned long long)sim_stats.console_lines);
+  printf ("raw HID reports:  %llu\n", (unsigned long long)sim_stats.raw_reports);
+  printf ("steno strokes:    %llu (%llu serial bytes, %llu bad)\n",
+          (unsigned long long)sim_stats.steno_strokes,
+          (unsigned long long)sim_stats.serial_bytes,
+          (unsigned long long)sim_stats.steno_errors);
+  printf ("blocked in wait:  %llu ms in %llu calls\n",
+          (unsigned long long)sim_stats.wait_ms, (unsigned long long)sim_stats.wait_calls);
+  printf ("delayed events:   %llu (max delay: %llu ms)\n",
+          (unsigned long long)sim_stats.delayed_events,
+          (unsigned long long)sim_stats.delay_ms_max);
+
+  if (key_reports)
+    print_key_reports (key_stats);
+  if (sim_profile)
+    print_profile (elapsed);
+
+  if (sim_output && sim_output != stdout)
+    fclose (sim_output);
+  free (trace.events);
+  return 0;
+}
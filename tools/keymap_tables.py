@@ -0,0 +1,269 @@
+# Shared helpers for the tools that compile tables for keymap.c, or read
+# it: basic QMK keycodes (HID usage IDs), a trie builder, header output, a
+# parser for the keymaps[] layers and their names, and ones for the host
+# commands and the macros.
+
+import re
+import sys
+
+keycodes = {}
+for i, c in enumerate("ABCDEFGHIJKLMNOPQRSTUVWXYZ"):
+    keycodes["KC_" + c] = 0x04 + i
+for i, c in enumerate("1234567890"):
+    keycodes["KC_" + c] = 0x1e + i
+keycodes.update({
+    "KC_ENT": 0x28, "KC_ESC": 0x29, "KC_BSPC": 0x2a, "KC_TAB": 0x2b,
+    "KC_SPC": 0x2c, "KC_MINS": 0x2d, "KC_EQL": 0x2e, "KC_LBRC": 0x2f,
+    "KC_RBRC": 0x30, "KC_BSLS": 0x31, "KC_SCLN": 0x33, "KC_QUOT": 0x34,
+    "KC_GRV": 0x35, "KC_COMM": 0x36, "KC_DOT": 0x37, "KC_SLSH": 0x38,
+})
+
+
+def fail(fn, lineno, msg):
+    sys.stderr.write("%s:%d: %s\n" % (fn, lineno, msg))
+    sys.exit(1)
+
+
+class TrieNode(object):
+    def __init__(self, prefix):
+        self.prefix = prefix
+        self.value = None
+        self.children = {}
+        self.index = None
+
+    def insert(self, keys):
+        """Add the path for the list of key names, return its last node."""
+        node = self
+        for key in keys:
+            code = keycodes[key]
+            if code not in node.children:
+                node.children[code] = TrieNode(node.prefix + [key])
+            node = node.children[code]
+        return node
+
+    def nodes(self):
+        """All nodes, breadth first, numbered in that order."""
+        nodes = [self]
+        for node in nodes:
+            for code in sorted(node.children):
+                nodes.append(node.children[code])
+        for i, node in enumerate(nodes):
+            node.index = i
+        return nodes
+
+
+def trie_tables(name, root, value_field, value_type, index_type, describe):
+    """C tables for a trie: every node has a value, and a dense range of
+    child indexes, one for each keycode between its smallest and largest
+    child key, so finding the next node is a subtraction and a lookup.
+    Index 0 (the root) never is a child, and means there is none."""
+    nodes = root.nodes()
+    limit = 1 << (8 if index_type == "uint8_t" else 16)
+    if len(nodes) >= limit:
+        sys.stderr.write("%s: too many trie nodes (%d)\n" % (name, len(nodes)))
+        sys.exit(1)
+
+    out = []
+    out.append("typedef struct {")
+    out.append("  %-8s %s;" % (value_type, value_field))
+    out.append("  uint8_t  first_key;")
+    out.append("  uint8_t  keys;")
+    out.append("  uint16_t edges;")
+    out.append("} %s_trie_node_t;" % name)
+    out.append("")
+    out.append("#define %s_TRIE_ROOT 0" % name.upper())
+    out.append("")
+
+    edges = []
+    out.append("static const %s_trie_node_t PROGMEM %s_trie_nodes[] = {" % (name, name))
+    for node in nodes:
+        first = min(node.children) if node.children else 0
+        span = max(node.children) - first + 1 if node.children else 0
+        out.append("  { %-20s 0x%02x, %2d, %4d }, // %s" %
+                   (describe(node.value) + ",", first, span, len(edges),
+                    " ".join(node.prefix) or "start"))
+        for code in range(first, first + span):
+            child = node.children.get(code)
+            edges.append(child.index if child else 0)
+    out.append("};")
+    out.append("")
+    out.append("static const %s PROGMEM %s_trie_edges[] = {" % (index_type, name))
+    out.extend(number_rows(edges))
+    out.append("};")
+    out.append("")
+    return out
+
+
+def number_rows(numbers, per_row=16):
+    if not numbers:
+        return ["  0,"]
+    width = len(str(max(numbers)))
+    return ["  " + " ".join("%*d," % (width, n) for n in numbers[i:i + per_row])
+            for i in range(0, len(numbers), per_row)]
+
+
+def generator_args(source, target):
+    """The source and target arguments of a table generator, and whether it
+    was asked to only --check the target; source and target are the file
+    names shown in the usage message."""
+    args = [arg for arg in sys.argv[1:] if arg != "--check"]
+    if len(args) != 2:
+        sys.stderr.write("Usage: %s [--check] %s %s\n" % (sys.argv[0], source, target))
+        sys.exit(1)
+    return args[0], args[1], "--check" in sys.argv[1:]
+
+
+def update(target, text, check=False):
+    """Write text to target, unless it is already there, so the build does
+    not see a change when there is none. When checking, fail if it is not
+    there instead."""
+    try:
+        with open(target) as f:
+            if f.read() == text:
+                return
+    except IOError:
+        pass
+
+    if check:
+        sys.stderr.write("%s is out of date, regenerate it with make -C tools\n" % target)
+        sys.exit(1)
+    with open(target, "w") as f:
+        f.write(text)
+
+
+def parse_commands(fn):
+    """The host commands in commands.def, as (opcode, name) pairs."""
+    commands = []
+
+    with open(fn) as f:
+        for lineno, line in enumerate(f, 1):
+            words = line.split("#", 1)[0].split()
+            if not words:
+                continue
+            if len(words) != 2:
+                fail(fn, lineno, "expected an opcode and a name")
+            try:
+                opcode = int(words[0], 0)
+            except ValueError:
+                fail(fn, lineno, "bad opcode %s" % words[0])
+            name = words[1]
+            if not 0 < opcode < 0x100:
+                fail(fn, lineno, "opcode %s is out of range" % words[0])
+            if not re.match(r"[a-z0-9_]+$", name):
+                fail(fn, lineno, "bad command name %s" % name)
+            for (o, n) in commands:
+                if o == opcode:
+                    fail(fn, lineno, "%s has the same opcode as %s" % (name, n))
+                if n == name:
+                    fail(fn, lineno, "duplicate command %s" % name)
+            commands.append((opcode, name))
+
+    return commands
+
+
+def parse_macros(fn):
+    """The macros in macros.def, as (macro, handler, argument) tuples, in
+    the order of their IDs, from 1."""
+    macros = []
+
+    with open(fn) as f:
+        for lineno, line in enumerate(f, 1):
+            words = line.split("#", 1)[0].split()
+            if not words:
+                continue
+            if len(words) != 3:
+                fail(fn, lineno, "expected a macro, a handler and an argument")
+            for word in words:
+                if not re.match(r"\w+$", word):
+                    fail(fn, lineno, "bad word %s" % word)
+            if words[0] in [m for (m, _, _) in macros]:
+                fail(fn, lineno, "duplicate macro %s" % words[0])
+            macros.append(tuple(words))
+
+    if len(macros) > 0xff:
+        sys.stderr.write("%s: too many macros (%d)\n" % (fn, len(macros)))
+        sys.exit(1)
+    return macros
+
+
+# The matrix position of every argument of LAYOUT_ergodox(), in order, as
+# the (row, col) pairs the keylogger reports. kXY in the macro is column X,
+# row Y of the matrix.
+LAYOUT_ergodox_args = [
+    "k00", "k01", "k02", "k03", "k04", "k05", "k06",
+    "k10", "k11", "k12", "k13", "k14", "k15", "k16",
+    "k20", "k21", "k22", "k23", "k24", "k25",
+    "k30", "k31", "k32", "k33", "k34", "k35", "k36",
+    "k40", "k41", "k42", "k43", "k44",
+    "k55", "k56", "k54", "k53", "k52", "k51",
+
+    "k07", "k08", "k09", "k0A", "k0B", "k0C", "k0D",
+    "k17", "k18", "k19", "k1A", "k1B", "k1C", "k1D",
+    "k28", "k29", "k2A", "k2B", "k2C", "k2D",
+    "k37", "k38", "k39", "k3A", "k3B", "k3C", "k3D",
+    "k49", "k4A", "k4B", "k4C", "k4D",
+    "k57", "k58", "k59", "k5C", "k5B", "k5A",
+]
+LAYOUT_ergodox = [(int(k[2], 16), int(k[1])) for k in LAYOUT_ergodox_args]
+
+
+def strip_comments(text):
+    text = re.sub(r"/\*.*?\*/", lambda m: "\n" * m.group(0).count("\n"), text, flags=re.S)
+    return re.sub(r"//[^\n]*", "", text)
+
+
+def split_args(text):
+    """Split text on the commas that are not inside parentheses."""
+    args, depth, arg = [], 0, ""
+    for ch in text:
+        if ch == "," and depth == 0:
+            args.append(arg.strip())
+            arg = ""
+            continue
+        depth += (ch == "(") - (ch == ")")
+        arg += ch
+    if arg.strip():
+        args.append(arg.strip())
+    return args
+
+
+def parse_keymaps(fn):
+    """The layers of keymaps[] in keymap.c, in order: a list of (name, keys)
+    pairs, where keys is a list of (keycode, (row, col)) pairs, in the order
+    of the LAYOUT_ergodox() arguments. Keycodes are the C expressions, with
+    the whitespace removed."""
+    with open(fn) as f:
+        text = strip_comments(f.read())
+
+    layers = []
+    for m in re.finditer(r"\[(\w+)\]\s*=\s*LAYOUT_ergodox\s*\(", text):
+        depth, end = 1, m.end()
+        while depth:
+            depth += (text[end] == "(") - (text[end] == ")")
+            end += 1
+        args = [re.sub(r"\s+", "", arg) for arg in split_args(text[m.end():end - 1])]
+        if len(args) != len(LAYOUT_ergodox):
+            sys.stderr.write("%s: layer %s has %d keys instead of %d\n" %
+                             (fn, m.group(1), len(args), len(LAYOUT_ergodox)))
+            sys.exit(1)
+        layers.append((m.group(1), list(zip(args, LAYOUT_ergodox))))
+    return layers
+
+
+# The names the keylogger output uses for the keymap.c layers, where they
+# differ: the base layer is named after the host layout it is typed with.
+LOG_LAYER_NAMES = {"BASE": "Dvorak"}
+
+
+def parse_log_layers(fn):
+    """The names of the layers in keymap.c, as the keylogger output uses
+    them, by layer number: the order of the enum that starts with BASE."""
+    with open(fn) as f:
+        text = strip_comments(f.read())
+
+    m = re.search(r"\benum\s*\{\s*(BASE\b[^}]*)\}", text)
+    if not m:
+        sys.stderr.write("%s: no layer enum found\n" % fn)
+        sys.exit(1)
+    names = [re.sub(r"=.*", "", name, flags=re.S).strip() for name in m.group(1).split(",")]
+    return [LOG_LAYER_NAMES.get(name, name) for name in names if name]
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+#
+# Prints the latency histograms the keyboard dumps on the HID console with
+# LEAD h ("LAT:" lines), and the profiler counters dumped with LEAD p
+# ("PROF:" lines), read from the output of hid_listen, or a saved log.
+# Dumps found in the input are added up.
+
+import argparse
+import re
+import sys
+
+BUCKETS = 12
+PATHS = ["plain", "macro", "tap dance", "leader", "hungarian"]
+PROFILED = ["matrix_scan_user", "process_record_user", "action_get_macro"]
+
+# The ErgoDox EZ runs at 16MHz
+CYCLES_PER_US = 16
+
+
+def parse(f, histograms, profile):
+    tick_us = None
+    for line in f:
+        m = re.search(r"PROF:(\d+):(\d+):([0-9a-f]{%d})" % (len(PROFILED) * 16), line)
+        if m:
+            profile["scans"] = int(m.group(1))
+            profile["tick-us"] = int(m.group(2))
+            for (i, fn) in enumerate(PROFILED):
+                calls = int(m.group(3)[i * 16:i * 16 + 8], 16)
+                ticks = int(m.group(3)[i * 16 + 8:i * 16 + 16], 16)
+                (c, t) = profile.get(fn, (0, 0))
+                profile[fn] = (c + calls, t + ticks)
+            continue
+
+        m = re.search(r"LAT:(\d+):(\d+):([0-9a-f]{%d})" % (BUCKETS * 4), line)
+        if not m:
+            continue
+        path = int(m.group(1))
+        tick_us = int(m.group(2))
+        counts = [int(m.group(3)[i:i + 4], 16) for i in range(0, BUCKETS * 4, 4)]
+        hist = histograms.setdefault(path, [0] * BUCKETS)
+        for i in range(BUCKETS):
+            hist[i] += counts[i]
+    return tick_us
+
+
+def bucket_label(i, tick_us):
+    def fmt(us):
+        return "%gms" % (us / 1000.0) if us >= 1000 else "%dus" % us
+    if i == BUCKETS - 1:
+        return ">= %s" % fmt((16 << (i - 1)) * tick_us)
+    return "< %s" % fmt((16 << i) * tick_us)
+
+
+def print_profile(profile):
+    print ("scans/sec: %d" % profile["scans"])
+    print ("%-20s %10s %12s %10s %12s" % ("", "calls", "total ms", "us/call", "cycles/call"))
+    for fn in PROFILED:
+        (calls, ticks) = profile[fn]
+        us = ticks * profile["tick-us"]
+        per_call = float(us) / calls if calls else 0.0
+        print ("%-20s %10d %12.1f %10.2f %12.0f" % (fn, calls, us / 1000.0, per_call,
+                                                    per_call * CYCLES_PER_US))
+
+
+def print_histograms(histograms, tick_us):
+    paths = sorted(histograms)
+    print ("%-12s" % "" + "".join("%11s" % (PATHS[p] if p < len(PATHS) else p) for p in paths))
+    for i in range(BUCKETS):
+        print ("%-12s" % bucket_label(i, tick_us) +
+               "".join("%11d" % histograms[p][i] for p in paths))
+    print ("%-12s" % "events" + "".join("%11d" % sum(histograms[p]) for p in paths))
+
+
+def main():
+    parser = argparse.ArgumentParser(description = "keyboard latency histogram and profile viewer")
+    parser.add_argument('files', metavar = 'FILE', nargs = '*', default = ['-'],
+                        help = 'hid_listen output, - or nothing for the standard input')
+    opts = parser.parse_args()
+
+    histograms = {}
+    profile = {}
+    tick_us = None
+    for fn in opts.files:
+        if fn == '-':
+            tick_us = parse(sys.stdin, histograms, profile) or tick_us
+        else:
+            with open(fn, errors = "replace") as f:
+                tick_us = parse(f, histograms, profile) or tick_us
+
+    if not histograms and not profile:
+        print ("No latency histograms or profiles found", file=sys.stderr)
+        sys.exit(1)
+
+    if histograms:
+        print_histograms(histograms, tick_us)
+    if histograms and profile:
+        print ()
+    if profile:
+        print_profile(profile)
+
+
+if __name__ == "__main__":
+    main()
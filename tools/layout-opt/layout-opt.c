@@ -0,0 +1,617 @@
+/*
+ * layout-opt: search for better alpha key placements for the ADORE layer.
+ *
+ * Counts the characters and character pairs of a text corpus, then runs
+ * simulated annealing over the placement of the ADORE layer's alpha keys
+ * (the letters and the punctuation between them), on every core, scoring
+ * placements with a finger effort model. The model uses the same finger
+ * assignment (finger_map) and matrix rows and columns as the heatmap tools:
+ *
+ *  - every key costs the strength of the finger it is typed with, more so
+ *    off the home row, and on the stretched inner and outer columns;
+ *  - a pair of characters typed with the same finger (on different keys)
+ *    costs extra, more the further the rows are apart; one jumping between
+ *    the top and bottom rows on neighbouring fingers costs a little extra;
+ *    and one rolling inward on the same row costs a little less.
+ *
+ * Effort is per character of the corpus placed on the layout. The best
+ * placements are printed in LAYOUT_ergodox order, along with the effort of
+ * the current ADORE and BASE layers (both read from keymap.c), and the
+ * difference to them.
+ */
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ROWS 6
+#define COLS 14
+
+// The characters placements are made of, and scored on
+static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz',./;";
+#define CHARS (sizeof (alphabet) - 1)
+#define SLOTS CHARS
+
+/* Corpus statistics, as frequencies */
+
+static double unigrams[CHARS];
+static double bigrams[CHARS][CHARS];
+
+static int char_index (int ch) {
+  const char *p;
+
+  if (!ch)
+    return -1;
+  p = strchr (alphabet, tolower (ch));
+  return p ? p - alphabet : -1;
+}
+
+static int read_corpus (FILE *f, uint64_t counts[256][256], uint64_t singles[256]) {
+  static unsigned char buf[1 << 20];
+  int prev = -1;
+  size_t n;
+
+  while ((n = fread (buf, 1, sizeof (buf), f)) > 0) {
+    for (size_t i = 0; i < n; i++) {
+      int ch = tolower (buf[i]);
+
+      singles[ch]++;
+      if (prev >= 0)
+        counts[prev][ch]++;
+      prev = ch;
+    }
+  }
+  return ferror (f) ? -1 : 0;
+}
+
+static void corpus_frequencies (uint64_t counts[256][256], uint64_t singles[256]) {
+  uint64_t total = 0;
+
+  for (size_t i = 0; i < CHARS; i++)
+    total += singles[(unsigned char)alphabet[i]];
+  if (!total)
+    total = 1;
+
+  for (size_t i = 0; i < CHARS; i++) {
+    unigrams[i] = (double)singles[(unsigned char)alphabet[i]] / total;
+    for (size_t j = 0; j < CHARS; j++)
+      bigrams[i][j] = (double)counts[(unsigned char)alphabet[i]][(unsigned char)alphabet[j]] / total;
+  }
+}
+
+/* Layouts, read from keymap.c */
+
+// The matrix position (row, col) of every LAYOUT_ergodox() argument, in
+// order. kXY in the macro is column X, row Y; see keymap_tables.py.
+static const char *layout_args[] = {
+  "k00", "k01", "k02", "k03", "k04", "k05", "k06",
+  "k10", "k11", "k12", "k13", "k14", "k15", "k16",
+  "k20", "k21", "k22", "k23", "k24", "k25",
+  "k30", "k31", "k32", "k33", "k34", "k35", "k36",
+  "k40", "k41", "k42", "k43", "k44",
+  "k55", "k56", "k54", "k53", "k52", "k51",
+
+  "k07", "k08", "k09", "k0A", "k0B", "k0C", "k0D",
+  "k17", "k18", "k19", "k1A", "k1B", "k1C", "k1D",
+  "k28", "k29", "k2A", "k2B", "k2C", "k2D",
+  "k37", "k38", "k39", "k3A", "k3B", "k3C", "k3D",
+  "k49", "k4A", "k4B", "k4C", "k4D",
+  "k57", "k58", "k59", "k5C", "k5B", "k5A",
+};
+#define LAYOUT_ARGS (sizeof (layout_args) / sizeof (layout_args[0]))
+
+typedef struct {
+  uint8_t c, r;
+} pos_t;
+
+typedef struct {
+  const char *name;
+  char       *keycodes[LAYOUT_ARGS];
+  // The alpha keys: where they are, and which character each types
+  int         slots;
+  int         slot_arg[SLOTS];
+  pos_t       slot_pos[SLOTS];
+  int8_t      slot_char[SLOTS];
+} layout_t;
+
+static pos_t arg_pos (size_t arg) {
+  const char *k = layout_args[arg];
+
+  return (pos_t){ .c = strtol ((char[]){ k[2], 0 }, NULL, 16), .r = k[1] - '0' };
+}
+
+// The character a keycode types on a US host layout, or on a Dvorak one
+static int keycode_char (const char *keycode, bool dvorak) {
+  static const char us[] = "-=qwertyuiop[]asdfghjkl;'zxcvbnm,./";
+  static const char dv[] = "[]',.pyfgcrl/=aoeuidhtns-;qjkxbmwvz";
+  static const struct {
+    const char *keycode;
+    char        ch;
+  } symbols[] = {
+    { "KC_MINS", '-' }, { "KC_EQL", '=' }, { "KC_LBRC", '[' }, { "KC_RBRC", ']' },
+    { "KC_SCLN", ';' }, { "KC_QUOT", '\'' }, { "KC_COMM", ',' }, { "KC_DOT", '.' },
+    { "KC_SLSH", '/' },
+  };
+  int ch = 0;
+
+  if (!strncmp (keycode, "KC_", 3) && strlen (keycode) == 4 && isupper (keycode[3]))
+    ch = tolower (keycode[3]);
+  for (size_t i = 0; !ch && i < sizeof (symbols) / sizeof (symbols[0]); i++)
+    if (!strcmp (keycode, symbols[i].keycode))
+      ch = symbols[i].ch;
+
+  if (ch && dvorak)
+    ch = dv[strchr (us, ch) - us];
+  return ch;
+}
+
+static char *read_file (const char *fn) {
+  FILE *f = fopen (fn, "r");
+  char *buf;
+  long size;
+
+  if (!f)
+    return NULL;
+  fseek (f, 0, SEEK_END);
+  size = ftell (f);
+  rewind (f);
+  buf = calloc (1, size + 1);
+  if (!buf || fread (buf, 1, size, f) != (size_t)size) {
+    fclose (f);
+    free (buf);
+    return NULL;
+  }
+  fclose (f);
+  return buf;
+}
+
+static void strip_comments (char *s) {
+  for (char *p = s; *p; p++) {
+    if (p[0] == '/' && p[1] == '/') {
+      while (*p && *p != '\n')
+        *p++ = ' ';
+    } else if (p[0] == '/' && p[1] == '*') {
+      while (*p && !(p[0] == '*' && p[1] == '/'))
+        *p++ = ' ';
+      if (*p)
+        p[0] = p[1] = ' ';
+    }
+  }
+}
+
+static int load_layout (const char *keymap, layout_t *layout, bool dvorak) {
+  char marker[64], *p, *arg;
+  size_t n = 0;
+  int depth = 1;
+
+  snprintf (marker, sizeof (marker), "[%s]", layout->name);
+  if (!(p = strstr (keymap, marker)) || !(p = strstr (p, "LAYOUT_ergodox")) || !(p = strchr (p, '('))) {
+    fprintf (stderr, "keymap.c: no %s layer\n", layout->name);
+    return -1;
+  }
+
+  for (arg = ++p; *p && depth; p++) {
+    if (*p == '(')
+      depth++;
+    else if (*p == ')')
+      depth--;
+
+    if ((*p == ',' && depth == 1) || !depth) {
+      char *s = arg, *e = p, *o;
+
+      if (n == LAYOUT_ARGS)
+        break;
+      o = layout->keycodes[n++] = calloc (1, e - s + 1);
+      for (; s < e; s++)
+        if (!isspace ((unsigned char)*s))
+          *o++ = *s;
+      arg = p + 1;
+    }
+  }
+  if (n != LAYOUT_ARGS || depth) {
+    fprintf (stderr, "keymap.c: the %s layer has %zu keys instead of %zu\n", layout->name, n, LAYOUT_ARGS);
+    return -1;
+  }
+
+  for (size_t i = 0; i < LAYOUT_ARGS; i++) {
+    int ch = char_index (keycode_char (layout->keycodes[i], dvorak));
+
+    if (ch < 0 || layout->slots == SLOTS)
+      continue;
+    layout->slot_arg[layout->slots] = i;
+    layout->slot_pos[layout->slots] = arg_pos (i);
+    layout->slot_char[layout->slots] = ch;
+    layout->slots++;
+  }
+  return 0;
+}
+
+/* The effort model */
+
+static const uint8_t finger_map[COLS] = { 0, 0, 1, 2, 3, 3, 3, 1, 1, 1, 2, 3, 4, 4 };
+
+// Hand (0: left, 1: right), and finger from the outside in: 0 is the
+// pinky, 3 the index finger, 4 the thumb.
+static void key_finger (pos_t p, int *hand, int *finger) {
+  if (p.r == 5 || (p.r == 4 && (p.c == 4 || p.c == 9))) {
+    *hand = p.c > 6;
+    *finger = 4;
+  } else {
+    *hand = p.c >= 7;
+    *finger = *hand ? 4 - finger_map[p.c] : finger_map[p.c];
+  }
+}
+
+static const double finger_strength[5] = { 1.5, 1.2, 1.0, 1.0, 1.0 };
+static const double row_cost[ROWS] = { 1.5, 0.5, 0, 0.6, 1.0, 0.5 };
+
+#define STRETCH_INNER 0.5
+#define STRETCH_OUTER 0.8
+#define SAME_FINGER   2.0
+#define SCISSOR       0.5
+#define INWARD_ROLL   -0.1
+
+static double key_cost (pos_t p) {
+  int hand, finger;
+  double cost;
+
+  key_finger (p, &hand, &finger);
+  cost = finger_strength[finger] * (1 + row_cost[p.r]);
+  if (p.c == 5 || p.c == 8)
+    cost += STRETCH_INNER;
+  if (p.c == 0 || p.c == 13)
+    cost += STRETCH_OUTER;
+  return cost;
+}
+
+static double pair_cost (pos_t a, pos_t b) {
+  int hand_a, finger_a, hand_b, finger_b, rows = abs (a.r - b.r);
+
+  key_finger (a, &hand_a, &finger_a);
+  key_finger (b, &hand_b, &finger_b);
+  if (hand_a != hand_b || (a.c == b.c && a.r == b.r))
+    return 0;
+  if (finger_a == finger_b)
+    return SAME_FINGER * (1 + rows);
+  if (abs (finger_a - finger_b) == 1 && rows >= 2)
+    return SCISSOR;
+  if (!rows && finger_b > finger_a)
+    return INWARD_ROLL;
+  return 0;
+}
+
+// Costs of the slots of the layout being optimized, and of their pairs
+static double slot_cost[SLOTS];
+static double slot_pair_cost[SLOTS][SLOTS];
+static int slots;
+
+static void model_init (const layout_t *layout) {
+  slots = layout->slots;
+  for (int s = 0; s < slots; s++) {
+    slot_cost[s] = key_cost (layout->slot_pos[s]);
+    for (int t = 0; t < slots; t++)
+      slot_pair_cost[s][t] = pair_cost (layout->slot_pos[s], layout->slot_pos[t]);
+  }
+}
+
+// The effort of any layout, not just of placements in the optimized slots
+static double layout_effort (const layout_t *layout) {
+  double effort = 0, placed = 0;
+
+  for (int s = 0; s < layout->slots; s++) {
+    int a = layout->slot_char[s];
+
+    placed += unigrams[a];
+    effort += unigrams[a] * key_cost (layout->slot_pos[s]);
+    for (int t = 0; t < layout->slots; t++)
+      effort += bigrams[a][layout->slot_char[t]] * pair_cost (layout->slot_pos[s], layout->slot_pos[t]);
+  }
+  return placed ? effort / placed : 0;
+}
+
+static double placement_effort (const int8_t *chars) {
+  double effort = 0;
+
+  for (int s = 0; s < slots; s++) {
+    effort += unigrams[chars[s]] * slot_cost[s];
+    for (int t = 0; t < slots; t++)
+      effort += bigrams[chars[s]][chars[t]] * slot_pair_cost[s][t];
+  }
+  return effort;
+}
+
+// The part of the effort that involves slots s or t
+static double swap_terms (const int8_t *chars, int s, int t) {
+  int a = chars[s], b = chars[t];
+  double terms = unigrams[a] * slot_cost[s] + unigrams[b] * slot_cost[t];
+
+  for (int u = 0; u < slots; u++) {
+    int c = chars[u];
+
+    terms += bigrams[a][c] * slot_pair_cost[s][u] + bigrams[c][a] * slot_pair_cost[u][s];
+    terms += bigrams[b][c] * slot_pair_cost[t][u] + bigrams[c][b] * slot_pair_cost[u][t];
+  }
+  // Pairs within s and t were counted twice
+  terms -= bigrams[a][a] * slot_pair_cost[s][s] + bigrams[b][b] * slot_pair_cost[t][t];
+  terms -= bigrams[a][b] * slot_pair_cost[s][t] + bigrams[b][a] * slot_pair_cost[t][s];
+  return terms;
+}
+
+/* Simulated annealing */
+
+typedef struct {
+  int8_t chars[SLOTS];
+  double effort;
+} candidate_t;
+
+static struct {
+  const layout_t  *start;
+  double           placed;
+  unsigned         iterations;
+  unsigned         runs;
+  unsigned         next_run;
+  uint64_t         seed;
+  candidate_t     *results;
+  pthread_mutex_t  lock;
+} search;
+
+static uint64_t xorshift64 (uint64_t *state) {
+  uint64_t x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+static double random_unit (uint64_t *state) {
+  return (xorshift64 (state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void anneal (unsigned run, candidate_t *best) {
+  uint64_t rng = search.seed + 0x9e3779b97f4a7c15ull * (run + 1);
+  int8_t chars[SLOTS];
+  double effort, t0 = 0.05, t1 = 0.00005, cooling;
+
+  memcpy (chars, search.start->slot_char, sizeof (chars));
+  // Start from a random placement
+  for (int s = slots - 1; s > 0; s--) {
+    int t = xorshift64 (&rng) % (s + 1), tmp = chars[s];
+
+    chars[s] = chars[t];
+    chars[t] = tmp;
+  }
+
+  effort = placement_effort (chars);
+  memcpy (best->chars, chars, sizeof (chars));
+  best->effort = effort;
+  cooling = pow (t1 / t0, 1.0 / search.iterations);
+
+  for (double temp = t0 * search.placed; temp > t1 * search.placed; temp *= cooling) {
+    int s = xorshift64 (&rng) % slots, t = xorshift64 (&rng) % slots, tmp;
+    double delta;
+
+    if (s == t)
+      continue;
+
+    delta = -swap_terms (chars, s, t);
+    tmp = chars[s]; chars[s] = chars[t]; chars[t] = tmp;
+    delta += swap_terms (chars, s, t);
+
+    if (delta <= 0 || random_unit (&rng) < exp (-delta / temp)) {
+      effort += delta;
+      if (effort < best->effort) {
+        memcpy (best->chars, chars, sizeof (chars));
+        best->effort = effort;
+      }
+    } else {
+      tmp = chars[s]; chars[s] = chars[t]; chars[t] = tmp;
+    }
+  }
+
+  // Recompute, so rounding errors of the deltas do not accumulate
+  best->effort = placement_effort (best->chars) / search.placed;
+}
+
+static void *anneal_worker (void *arg) {
+  (void)arg;
+
+  for (;;) {
+    unsigned run;
+
+    pthread_mutex_lock (&search.lock);
+    run = search.next_run++;
+    pthread_mutex_unlock (&search.lock);
+    if (run >= search.runs)
+      return NULL;
+
+    anneal (run, &search.results[run]);
+  }
+}
+
+/* Output */
+
+static int candidate_cmp (const void *a, const void *b) {
+  double d = ((const candidate_t *)a)->effort - ((const candidate_t *)b)->effort;
+
+  return (d > 0) - (d < 0);
+}
+
+static const char *char_keycode (int ch) {
+  static const char *symbols[] = { "KC_QUOT", "KC_COMM", "KC_DOT", "KC_SLSH", "KC_SCLN" };
+  static char buf[8];
+
+  if (alphabet[ch] >= 'a' && alphabet[ch] <= 'z') {
+    snprintf (buf, sizeof (buf), "KC_%c", toupper (alphabet[ch]));
+    return buf;
+  }
+  return symbols[ch - 26];
+}
+
+// The alpha rows of a placement, as they are laid out in LAYOUT_ergodox()
+static void print_placement (const layout_t *layout, const int8_t *chars) {
+  int line = -1;
+
+  for (int s = 0; s < layout->slots; s++) {
+    pos_t p = layout->slot_pos[s];
+    int row = (p.c >= 7) * ROWS + p.r;
+
+    if (row != line) {
+      printf ("%s   %s", line < 0 ? "" : "\n", p.c >= 7 ? "  " : "");
+      line = row;
+    }
+    printf (" ,%-7s", char_keycode (chars[s]));
+  }
+  printf ("\n     ");
+  for (int s = 0; s < layout->slots; s++)
+    putchar (alphabet[chars[s]]);
+  putchar ('\n');
+}
+
+static void print_delta (const char *name, double effort, double reference) {
+  printf ("%+.4f (%+.2f%%) vs %s", effort - reference, (effort - reference) / reference * 100, name);
+}
+
+static void usage (const char *name) {
+  fprintf (stderr,
+           "Usage: %s [options] [CORPUS...]\n"
+           "\n"
+           "Counts the characters and character pairs of the CORPUS files (or the\n"
+           "standard input), and searches for alpha key placements on the ADORE\n"
+           "layer that take less effort to type them with.\n"
+           "\n"
+           "  --keymap FILE       the keymap.c to read the layers from\n"
+           "                      (default: keymap.c two directories above this program)\n"
+           "  --threads N         annealing threads (default: one per core)\n"
+           "  --runs N            annealing runs, from random placements (default: 4 per thread)\n"
+           "  --iterations N      key swaps tried in each run (default: 2000000)\n"
+           "  --top N             how many of the best placements to print (default: 5)\n"
+           "  --seed N            random seed (default: 1)\n",
+           name);
+}
+
+int main (int argc, char *argv[]) {
+  static const struct option long_options[] = {
+    { "keymap", required_argument, NULL, 'k' },
+    { "threads", required_argument, NULL, 't' },
+    { "runs", required_argument, NULL, 'r' },
+    { "iterations", required_argument, NULL, 'i' },
+    { "top", required_argument, NULL, 'n' },
+    { "seed", required_argument, NULL, 's' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 },
+  };
+  static uint64_t counts[256][256], singles[256];
+  layout_t adore = { .name = "ADORE" }, base = { .name = "BASE" };
+  unsigned threads = sysconf (_SC_NPROCESSORS_ONLN), top = 5, shown = 0;
+  double adore_effort, base_effort;
+  char *keymap_fn = NULL, *keymap;
+  pthread_t *workers;
+  int opt;
+
+  search.iterations = 2000000;
+  search.seed = 1;
+
+  while ((opt = getopt_long (argc, argv, "h", long_options, NULL)) != -1) {
+    switch (opt) {
+    case 'k': keymap_fn = optarg; break;
+    case 't': threads = atoi (optarg); break;
+    case 'r': search.runs = atoi (optarg); break;
+    case 'i': search.iterations = atoi (optarg); break;
+    case 'n': top = atoi (optarg); break;
+    case 's': search.seed = strtoull (optarg, NULL, 0); break;
+    case 'h':
+      usage (argv[0]);
+      return 0;
+    default:
+      usage (argv[0]);
+      return 1;
+    }
+  }
+  if (!threads)
+    threads = 1;
+  if (!search.runs)
+    search.runs = threads * 4;
+
+  if (!keymap_fn) {
+    char *slash;
+
+    keymap_fn = malloc (strlen (argv[0]) + 16);
+    strcpy (keymap_fn, argv[0]);
+    slash = strrchr (keymap_fn, '/');
+    strcpy (slash ? slash + 1 : keymap_fn, "../../keymap.c");
+  }
+  if (!(keymap = read_file (keymap_fn))) {
+    perror (keymap_fn);
+    return 1;
+  }
+  strip_comments (keymap);
+  if (load_layout (keymap, &adore, false) < 0 || load_layout (keymap, &base, true) < 0)
+    return 1;
+
+  if (optind == argc && read_corpus (stdin, counts, singles) < 0) {
+    perror ("stdin");
+    return 1;
+  }
+  for (; optind < argc; optind++) {
+    FILE *f = fopen (argv[optind], "r");
+
+    if (!f || read_corpus (f, counts, singles) < 0) {
+      perror (argv[optind]);
+      return 1;
+    }
+    fclose (f);
+  }
+  corpus_frequencies (counts, singles);
+
+  model_init (&adore);
+  adore_effort = layout_effort (&adore);
+  base_effort = layout_effort (&base);
+  for (int s = 0; s < adore.slots; s++)
+    search.placed += unigrams[adore.slot_char[s]];
+  if (!search.placed) {
+    fprintf (stderr, "The corpus has none of the characters on the ADORE layer.\n");
+    return 1;
+  }
+
+  search.start = &adore;
+  search.results = calloc (search.runs, sizeof (candidate_t));
+  workers = calloc (threads, sizeof (pthread_t));
+  pthread_mutex_init (&search.lock, NULL);
+  for (unsigned i = 0; i < threads; i++)
+    pthread_create (&workers[i], NULL, anneal_worker, NULL);
+  for (unsigned i = 0; i < threads; i++)
+    pthread_join (workers[i], NULL);
+
+  qsort (search.results, search.runs, sizeof (candidate_t), candidate_cmp);
+
+  printf ("ADORE: effort %.4f\n", adore_effort);
+  print_placement (&adore, adore.slot_char);
+  printf ("BASE: effort %.4f\n", base_effort);
+  print_placement (&base, base.slot_char);
+
+  for (unsigned i = 0; i < search.runs && shown < top; i++) {
+    candidate_t *c = &search.results[i];
+
+    if (i && !memcmp (c->chars, search.results[i - 1].chars, sizeof (c->chars)))
+      continue;
+
+    printf ("\n#%u: effort %.4f, ", ++shown, c->effort);
+    print_delta ("ADORE", c->effort, adore_effort);
+    printf (", ");
+    print_delta ("BASE", c->effort, base_effort);
+    putchar ('\n');
+    print_placement (&adore, c->chars);
+  }
+
+  return 0;
+}
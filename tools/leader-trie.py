@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+#
+# Compiles the leader sequence table (leader.def) into a trie, stored in
+# PROGMEM, that keymap.c walks one key at a time as the sequence is typed.
+# Every node has the action of the sequence ending there (LEADER_NONE if
+# there is none).
+#
+# Usage: leader-trie.py [--check] leader.def leader-trie.h
+#
+# The output is only rewritten when it changes. With --check, it is not
+# written at all, and the tool fails if it is out of date: the build runs
+# it that way.
+
+import os
+
+from keymap_tables import TrieNode, fail, generator_args, keycodes, trie_tables, update
+
+MAX_SEQUENCE = 5
+
+
+def parse(fn):
+    root = TrieNode([])
+    actions = []
+
+    with open(fn) as f:
+        for lineno, line in enumerate(f, 1):
+            words = line.split("#", 1)[0].split()
+            if not words:
+                continue
+            action, keys = words[0], words[1:]
+            if not keys:
+                fail(fn, lineno, "%s has no keys" % action)
+            if len(keys) > MAX_SEQUENCE:
+                fail(fn, lineno, "%s is longer than %d keys" % (action, MAX_SEQUENCE))
+            if action in actions:
+                fail(fn, lineno, "duplicate action %s" % action)
+            for key in keys:
+                if key not in keycodes:
+                    fail(fn, lineno, "unknown keycode %s" % key)
+
+            node = root.insert(keys)
+            if node.value:
+                fail(fn, lineno, "%s has the same keys as %s" % (action, node.value))
+            node.value = action
+            actions.append(action)
+
+    return root, actions
+
+
+def generate(root, actions, source):
+    out = []
+    out.append("/* Generated from %s by tools/leader-trie.py, do not edit! */" % source)
+    out.append("")
+    out.append("#pragma once")
+    out.append("")
+    out.append("enum {")
+    out.append("  LEADER_NONE = 0,")
+    for action in actions:
+        out.append("  %s," % action)
+    out.append("};")
+    out.append("")
+    out.extend(trie_tables("leader", root, "action", "uint8_t", "uint8_t",
+                           lambda action: action or "LEADER_NONE"))
+    return "\n".join(out)
+
+
+def main():
+    (source, target, check) = generator_args("leader.def", "leader-trie.h")
+
+    root, actions = parse(source)
+    update(target, generate(root, actions, os.path.basename(source)), check)
+
+
+if __name__ == "__main__":
+    main()
@@ -5,11 +5,13 @@ import sys
 import re
 import argparse
 import time
+import threading
 
 from math import floor
-from os.path import dirname
+from os.path import abspath, dirname, join
 from subprocess import Popen, PIPE, STDOUT
 from blessings import Terminal
+from keymap_tables import parse_log_layers
 
 class Heatmap(object):
     coords = [
@@ -100,6 +102,14 @@ class Heatmap(object):
         self.total = 0
         self.max_cnt = 0
         self.layout = layout
+        self.dirty = True
+
+    def copy(self):
+        h = Heatmap(self.layout)
+        h.log = dict(self.log)
+        h.total = self.total
+        h.max_cnt = self.max_cnt
+        return h
 
     def update_log(self, coords):
         (c, r) = coords
@@ -107,11 +117,12 @@ class Heatmap(object):
             self.log[(c, r)] = 0
         self.log[(c, r)] = self.log[(c, r)] + 1
         self.total = self.total + 1
+        self.dirty = True
         if self.max_cnt < self.log[(c, r)]:
             self.max_cnt = self.log[(c, r)]
 
     def get_heatmap(self):
-        with open("%s/heatmap-layout.%s.json" % (dirname(sys.argv[0]), self.layout), "r") as f:
+        with open(layout_fn(self.layout), "r") as f:
             self.heatmap = json.load (f)
 
         ## Reset colors
@@ -201,7 +212,12 @@ class Heatmap(object):
                 stats['hands'][hmap[hand_idx]]['fingers'][fmap[finger_idx + hand_idx * 5]] = round(float(hand[finger_idx]) / total * 100, 2)
         return stats
 
-def dump_all(out_dir, heatmaps):
+def write_json(fn, data):
+    with open(fn + ".tmp", "w") as f:
+        json.dump(data, f)
+    os.rename(fn + ".tmp", fn)
+
+def dump_all(out_dir, heatmaps, changed):
     stats = {}
     t = Terminal()
     t.clear()
@@ -216,8 +232,8 @@ def dump_all(out_dir, heatmaps):
         if len(heatmaps[layer].log) == 0:
             continue
 
-        with open ("%s/%s.json" % (out_dir, layer), "w") as f:
-            json.dump(heatmaps[layer].get_heatmap(), f)
+        if layer in changed:
+            write_json("%s/%s.json" % (out_dir, layer), heatmaps[layer].get_heatmap())
         stats[layer] = heatmaps[layer].get_stats()
 
         left = stats[layer]['hands']['left']
@@ -235,10 +251,72 @@ def dump_all(out_dir, heatmaps):
                 ' {t.bright_red}thumb{t.white}  |     {left[thumb]:6.2f}%     |     {right[thumb]:6.2f}%     |\n' + \
                 '').format(left=left['fingers'], right=right['fingers'], t=t))
 
-def process_line(line, heatmaps, opts, stamped_log = None):
+## Records carry the layer by number, named after the layer enum of
+## keymap.c. Only layers with a heatmap layout get a heatmap: keys pressed on
+## the others are skipped, with a warning.
+
+tools_dir = dirname(abspath(__file__))
+layer_names = []
+skipped_layers = set()
+dropped_records = 0
+
+def layout_fn(layer):
+    return join(tools_dir, "heatmap-layout.%s.json" % layer)
+
+def has_layout(layer):
+    if os.path.exists(layout_fn(layer)):
+        return True
+    if layer not in skipped_layers:
+        print ("No heatmap layout for layer %s, skipping its keys" % layer, file = sys.stderr)
+        skipped_layers.add(layer)
+    return False
+
+def layer_name(layer):
+    if layer < len(layer_names):
+        return layer_names[layer]
+    return "L%d" % layer
+
+def expand_batch(line, quiet = False):
+    global dropped_records
+
+    m = re.search ('KB:([0-9a-f]{4}):([0-9a-f]*)', line)
+    if not m:
+        return None
+
+    dropped = int(m.group(1), 16)
+    if dropped != dropped_records and not quiet:
+        print ("Keylogger dropped %d records" % ((dropped - dropped_records) % 0x10000),
+               file = sys.stderr)
+    dropped_records = dropped
+
+    lines = []
+    records = m.group(2)
+    for i in range(0, len(records) - 11, 12):
+        pos = int(records[i:i + 2], 16)
+        layer = int(records[i + 2:i + 4], 16)
+        lines.append("KL: col=%02d, row=%02d, pressed=%d, layer=%s\n" % ((pos >> 1) & 7, pos >> 4, pos & 1,
+                                                                         layer_name(layer)))
+    return lines
+
+## Batches are written to the stamped-log as they are, so the device's
+## timestamps of the records in them are kept; replaying them does not warn
+## about dropped records again. Returns the number of key events counted.
+
+def process_line(line, heatmaps, opts, stamped_log = None, replay = False):
+    batch = expand_batch(line, replay)
+    if batch is not None:
+        if stamped_log is not None and batch:
+            print ("%10.10f %s" % (time.time(), line[line.index("KB:"):]),
+                   file = stamped_log, end = '')
+            stamped_log.flush()
+        found = 0
+        for l in batch:
+            found = found + process_line(l, heatmaps, opts)
+        return found
+
     m = re.search ('KL: col=(\d+), row=(\d+), pressed=(\d+), layer=(.*)', line)
     if not m:
-        return False
+        return 0
     if stamped_log is not None:
         if line.startswith("KL:"):
             print ("%10.10f %s" % (time.time(), line),
@@ -250,11 +328,15 @@ def process_line(line, heatmaps, opts, stamped_log = None):
 
     (c, r, l) = (int(m.group (2)), int(m.group (1)), m.group (4))
     if (c, r) not in opts.allowed_keys:
-        return False
+        return 0
 
+    if l not in heatmaps:
+        if not has_layout(l):
+            return 0
+        heatmaps[l] = Heatmap(l)
     heatmaps[l].update_log ((c, r))
 
-    return True
+    return 1
 
 def setup_allowed_keys(opts):
     if len(opts.only_key):
@@ -280,7 +362,106 @@ def setup_allowed_keys(opts):
 
     return incmap
 
+## The snapshot holds the counters of every layer, along with how much of the
+## stamped-log they cover, so that on startup, only the rest of the log needs
+## to be replayed. If the log is shorter than that (it was truncated or
+## replaced), or the snapshot was made with a different set of allowed keys,
+## it is ignored, and the whole log is replayed.
+def snapshot_fn(out_dir):
+    return "%s/stamped-log.snapshot" % out_dir
+
+def load_snapshot(out_dir, heatmaps, opts):
+    try:
+        with open(snapshot_fn(out_dir), "r") as f:
+            snapshot = json.load(f)
+        offset = snapshot["offset"]
+        if offset > os.path.getsize("%s/stamped-log" % out_dir):
+            return 0
+        if sorted(map(tuple, snapshot["allowed-keys"])) != sorted(opts.allowed_keys):
+            return 0
+        layers = snapshot["layers"]
+    except (IOError, OSError, ValueError, KeyError, TypeError):
+        return 0
+
+    for l in layers:
+        if not has_layout(l):
+            continue
+        heatmaps[l] = Heatmap(l)
+        for (c, r, n) in layers[l]["log"]:
+            heatmaps[l].log[(c, r)] = n
+        heatmaps[l].total = layers[l]["total"]
+        heatmaps[l].max_cnt = layers[l]["max-cnt"]
+    return offset
+
+def save_snapshot(out_dir, heatmaps, opts, offset):
+    snapshot = {
+        "offset": offset,
+        "allowed-keys": sorted(opts.allowed_keys),
+        "layers": {}
+    }
+    for l in heatmaps:
+        snapshot["layers"][l] = {
+            "log": [[c, r, n] for ((c, r), n) in heatmaps[l].log.items()],
+            "total": heatmaps[l].total,
+            "max-cnt": heatmaps[l].max_cnt
+        }
+
+    write_json(snapshot_fn(out_dir), snapshot)
+
+## Dumping happens in the background, so reading the log never waits for the
+## files to be written, or the terminal to be redrawn. The main loop submits
+## copies of the layers that changed since the last dump, and the offset of
+## the stamped-log they cover; if it does so faster than the dumper can keep
+## up, the submissions are merged, and only the latest state gets written.
+class Dumper(threading.Thread):
+    def __init__(self, out_dir, opts):
+        threading.Thread.__init__(self, daemon = True)
+        self.out_dir = out_dir
+        self.opts = opts
+        self.heatmaps = {}
+        self.cond = threading.Condition()
+        self.pending = {}
+        self.offset = None
+        self.queued = False
+        self.done = False
+
+    def submit(self, heatmaps, offset):
+        changed = {}
+        for l in heatmaps:
+            if heatmaps[l].dirty:
+                changed[l] = heatmaps[l].copy()
+                heatmaps[l].dirty = False
+
+        with self.cond:
+            self.pending.update(changed)
+            self.offset = offset
+            self.queued = True
+            self.cond.notify()
+
+    def finish(self):
+        with self.cond:
+            self.done = True
+            self.cond.notify()
+        self.join()
+
+    def run(self):
+        while True:
+            with self.cond:
+                while not self.queued and not self.done:
+                    self.cond.wait()
+                (changed, offset, queued, done) = (self.pending, self.offset, self.queued, self.done)
+                (self.pending, self.queued) = ({}, False)
+
+            if queued:
+                self.heatmaps.update(changed)
+                dump_all(self.out_dir, self.heatmaps, changed)
+                if offset is not None:
+                    save_snapshot(self.out_dir, self.heatmaps, self.opts, offset)
+            if done:
+                return
+
 def main(opts):
+    layer_names[:] = parse_log_layers(opts.keymap)
     heatmaps = {"Dvorak": Heatmap("Dvorak"),
                 "ADORE": Heatmap("ADORE")
     }
@@ -293,15 +474,13 @@ def main(opts):
     opts.allowed_keys = setup_allowed_keys(opts)
 
     if not opts.one_shot:
+        offset = load_snapshot(out_dir, heatmaps, opts)
 
         try:
-            with open("%s/stamped-log" % out_dir, "r") as f:
-                while True:
-                    line = f.readline()
-                    if not line:
-                        break
-                    if not process_line(line, heatmaps, opts):
-                        continue
+            with open("%s/stamped-log" % out_dir, "rb") as f:
+                f.seek(offset)
+                for line in f:
+                    process_line(line.decode("utf-8", "replace"), heatmaps, opts, replay = True)
         except:
             pass
 
@@ -309,20 +488,30 @@ def main(opts):
     else:
         stamped_log = None
 
+    def stamped_log_size():
+        if stamped_log is None:
+            return None
+        return os.fstat(stamped_log.fileno()).st_size
+
+    dumper = Dumper(out_dir, opts)
+    dumper.start()
+
     while True:
         line = sys.stdin.readline()
         if not line:
             break
-        if not process_line(line, heatmaps, opts, stamped_log):
+        found = process_line(line, heatmaps, opts, stamped_log)
+        if not found:
             continue
 
-        cnt = cnt + 1
+        cnt = cnt + found
 
         if opts.dump_interval != -1 and cnt >= opts.dump_interval and not opts.one_shot:
             cnt = 0
-            dump_all(out_dir, heatmaps)
+            dumper.submit(heatmaps, stamped_log_size())
 
-    dump_all (out_dir, heatmaps)
+    dumper.submit(heatmaps, stamped_log_size())
+    dumper.finish()
 
 if __name__ == "__main__":
     parser = argparse.ArgumentParser (description = "keylog to heatmap processor")
@@ -334,6 +523,9 @@ if __name__ == "__main__":
                          default = [], help = 'Ignore the key at position (x, y)')
     parser.add_argument ('--only-key', dest = 'only_key', action = 'append', type = str,
                          default = [], help = 'Only include key at position (x, y)')
+    parser.add_argument ('--keymap', dest = 'keymap', action = 'store',
+                         default = join(tools_dir, "..", "keymap.c"),
+                         help = 'The keymap to take the layer names from')
     parser.add_argument ('--one-shot', dest = 'one_shot', action = 'store_true',
                          help = 'Do not load previous data, and do not update it, either.')
     args = parser.parse_args()
@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+#
+# Compiles the macro list (macros.def) into an enum of the macro IDs, and a
+# PROGMEM table of the handler and argument of every ID, which
+# action_get_macro() dispatches through. Prototypes of the handlers are
+# included, so the table can come before their definitions.
+#
+# Usage: macro-table.py [--check] macros.def macro-table.h
+#
+# The output is only rewritten when it changes. With --check, it is not
+# written at all, and the tool fails if it is out of date: the build runs
+# it that way.
+
+import os
+
+from keymap_tables import generator_args, parse_macros, update
+
+
+def generate(macros, source):
+    handlers = []
+    for (_, handler, _) in macros:
+        if handler not in handlers:
+            handlers.append(handler)
+    width = max(len(macro) for (macro, _, _) in macros) + 2
+
+    out = []
+    out.append("/* Generated from %s by tools/macro-table.py, do not edit! */" % source)
+    out.append("")
+    out.append("#pragma once")
+    out.append("")
+    out.append("enum {")
+    out.append("  NONE = 0,")
+    for (macro, _, _) in macros:
+        out.append("  %s," % macro)
+    out.append("  MACRO_COUNT")
+    out.append("};")
+    out.append("")
+    out.append("typedef const macro_t *(*ang_macro_fn_t) (keyrecord_t *record, uint8_t arg);")
+    out.append("")
+    out.append("typedef struct {")
+    out.append("  ang_macro_fn_t fn;")
+    out.append("  uint8_t        arg;")
+    out.append("} ang_macro_t;")
+    out.append("")
+    for handler in handlers:
+        out.append("static const macro_t *%s (keyrecord_t *record, uint8_t arg);" % handler)
+    out.append("")
+    out.append("static const ang_macro_t PROGMEM macro_table[MACRO_COUNT] = {")
+    for (macro, handler, arg) in macros:
+        out.append("  %-*s = { %s, %s }," % (width, "[%s]" % macro, handler, arg))
+    out.append("};")
+    out.append("")
+    return "\n".join(out)
+
+
+def main():
+    (source, target, check) = generator_args("macros.def", "macro-table.h")
+
+    macros = parse_macros(source)
+    update(target, generate(macros, os.path.basename(source)), check)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,277 @@
+#!/usr/bin/env python3
+#
+# Builds the keymap with every combination of the optional features in
+# rules.mk (the "FOO_ENABLE ?= ..." flags), and reports the flash and RAM
+# each one uses, and which symbols of keymap.c that comes from. Fails when
+# a combination does not fit the budget.
+#
+# With --qmk, the firmware itself is built, in the given QMK checkout, and
+# measured with avr-size and avr-nm. Without it, keymap.c is compiled for
+# the host, with tools/host-sim's stand-ins: the sizes are not the AVR
+# ones, but they show which features and symbols cost the most, without
+# an AVR toolchain.
+
+import argparse
+import concurrent.futures
+import glob
+import itertools
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+from os.path import abspath, dirname, join
+
+TOOLS_DIR = dirname(abspath(__file__))
+KEYMAP_DIR = dirname(TOOLS_DIR)
+HOST_SIM_DIR = join(TOOLS_DIR, "host-sim")
+
+# The ErgoDox EZ: an atmega32u4 with a 512 byte bootloader, and 2.5k of RAM,
+# of which 512 bytes are left for the stack.
+FLASH_BUDGET = 32 * 1024 - 512
+RAM_BUDGET = 2048
+
+
+def feature_flags(fn):
+    """The optional features in rules.mk, and which ones imply others."""
+    with open(fn) as f:
+        text = f.read()
+    flags = re.findall(r"^(\w+_ENABLE)\s*\?=\s*(?:yes|no)\s*$", text, re.M)
+    implies = {}
+    for (flag, other) in re.findall(r"^ifeq\s*\(\$\{(\w+)\},\s*yes\)\n(\w+)\s*=\s*yes\s*$", text, re.M):
+        if flag in flags and other in flags:
+            implies[flag] = other
+    return flags, implies
+
+
+def combinations(flags, implies):
+    for values in itertools.product([False, True], repeat = len(flags)):
+        combo = dict(zip(flags, values))
+        # Combinations that differ only in an implied flag build the same
+        if any(combo[flag] and not combo[other] for (flag, other) in implies.items()):
+            continue
+        yield combo
+
+
+def make_args(combo):
+    return ["%s=%s" % (flag, "yes" if on else "no") for (flag, on) in sorted(combo.items())]
+
+
+def run(cmd, cwd = None):
+    p = subprocess.run(cmd, cwd = cwd, stdout = subprocess.PIPE, stderr = subprocess.STDOUT,
+                       universal_newlines = True)
+    if p.returncode:
+        sys.stderr.write("%s failed:\n%s" % (" ".join(cmd), p.stdout))
+        return None
+    return p.stdout
+
+
+def sizes(size_tool, fn):
+    """text, data and bss, as reported by size."""
+    out = run([size_tool, fn])
+    if out is None:
+        return None
+    return [int(n) for n in out.splitlines()[1].split()[:3]]
+
+
+def symbols(nm_tool, fn):
+    """The size of every symbol, keyed by name, with its section kind."""
+    out = run([nm_tool, "-S", "--size-sort", fn])
+    syms = {}
+    for line in (out or "").splitlines():
+        fields = line.split()
+        if len(fields) != 4:
+            continue
+        (_, size, kind, name) = fields
+        kind = kind.lower()
+        section = "text" if kind in "tr" else "data" if kind == "d" else "bss" if kind == "b" else None
+        if not section:
+            continue
+        # Function-local statics get a numeric suffix
+        name = re.sub(r"\.\d+$", "", name)
+        syms[name] = (section, syms.get(name, (None, 0))[1] + int(size, 16))
+    return syms
+
+
+class HostBuild(object):
+    size = "size"
+    nm = "nm"
+
+    def __init__(self, cflags, workdir):
+        self.cflags = cflags
+        self.workdir = workdir
+
+    def build(self, n, combo):
+        out = run(["make", "-s", "--no-print-directory", "print-cppflags"] + make_args(combo),
+                  cwd = HOST_SIM_DIR)
+        if out is None:
+            return None
+        obj = join(self.workdir, "keymap-%d.o" % n)
+        cc = os.environ.get("CC", "cc")
+        if run([cc] + out.split() + self.cflags.split() +
+               ["-c", "-o", obj, join(KEYMAP_DIR, "keymap.c")], cwd = HOST_SIM_DIR) is None:
+            return None
+        return (obj, obj)
+
+
+class FirmwareBuild(object):
+    size = "avr-size"
+    nm = "avr-nm"
+
+    def __init__(self, qmk, keyboard, keymap, workdir):
+        self.qmk = qmk
+        self.target = "%s:%s" % (keyboard, keymap)
+        self.name = "%s_%s" % (keyboard, keymap)
+        self.workdir = workdir
+
+    def build(self, n, combo):
+        if run(["make", "-s", self.target] + make_args(combo), cwd = self.qmk) is None:
+            return None
+        elf = join(self.qmk, ".build", "%s.elf" % self.name)
+        objs = glob.glob(join(self.qmk, ".build", "obj_%s" % self.name, "**", "keymap.o"),
+                         recursive = True)
+        if not objs:
+            sys.stderr.write("keymap.o not found in %s\n" % join(self.qmk, ".build"))
+            return None
+        # The next build overwrites these
+        kept = [join(self.workdir, "%d.elf" % n), join(self.workdir, "%d.o" % n)]
+        shutil.copy(elf, kept[0])
+        shutil.copy(objs[0], kept[1])
+        return kept
+
+
+def main():
+    parser = argparse.ArgumentParser(description = "flash and RAM budget check")
+    parser.add_argument('--qmk', dest = 'qmk',
+                        help = 'Build the firmware in this QMK checkout, instead of keymap.c for the host')
+    parser.add_argument('--keyboard', dest = 'keyboard', default = 'ergodox_ez',
+                        help = 'The keyboard to build the firmware for (default: ergodox_ez)')
+    parser.add_argument('--keymap', dest = 'keymap', default = 'algernon_master',
+                        help = 'The name of this keymap in the QMK checkout (default: algernon_master)')
+    parser.add_argument('--flags', dest = 'flags', nargs = '+',
+                        help = 'Only vary these features, the rest stay at their default')
+    parser.add_argument('--flash-budget', dest = 'flash', type = int,
+                        help = 'Fail if text + data is larger (default: %d with --qmk, none otherwise)' %
+                        FLASH_BUDGET)
+    parser.add_argument('--ram-budget', dest = 'ram', type = int,
+                        help = 'Fail if data + bss is larger (default: %d with --qmk, none otherwise)' %
+                        RAM_BUDGET)
+    parser.add_argument('--host-cflags', dest = 'cflags', default = '-std=gnu11 -Os',
+                        help = 'Compiler flags for the host build (default: -std=gnu11 -Os)')
+    parser.add_argument('-j', '--jobs', dest = 'jobs', type = int, default = os.cpu_count(),
+                        help = 'Host builds to run at once (default: the number of CPUs)')
+    parser.add_argument('--symbols', dest = 'symbols', type = int, default = 25,
+                        help = 'Show this many of the largest symbols (default: 25)')
+    opts = parser.parse_args()
+
+    flags, implies = feature_flags(join(KEYMAP_DIR, "rules.mk"))
+    if opts.flags:
+        unknown = [flag for flag in opts.flags if flag not in flags]
+        if unknown:
+            sys.stderr.write("Unknown features: %s\n" % " ".join(unknown))
+            sys.exit(1)
+        flags = opts.flags
+        implies = dict((flag, other) for (flag, other) in implies.items()
+                       if flag in flags and other in flags)
+    combos = list(combinations(flags, implies))
+
+    workdir = tempfile.mkdtemp(prefix = "size-budget.")
+    try:
+        if opts.qmk:
+            builder = FirmwareBuild(opts.qmk, opts.keyboard, opts.keymap, workdir)
+            flash_budget = opts.flash or FLASH_BUDGET
+            ram_budget = opts.ram or RAM_BUDGET
+            jobs = 1
+        else:
+            builder = HostBuild(opts.cflags, workdir)
+            (flash_budget, ram_budget) = (opts.flash, opts.ram)
+            jobs = opts.jobs
+
+        with concurrent.futures.ThreadPoolExecutor(max_workers = jobs) as pool:
+            built = list(pool.map(lambda args: builder.build(*args), enumerate(combos)))
+
+        # Combinations that failed to build have no sizes, nor symbols
+        results = []
+        for (combo, files) in zip(combos, built):
+            if files is None:
+                results.append((combo, None, {}))
+                continue
+            (image, obj) = files
+            results.append((combo, sizes(builder.size, image), symbols(builder.nm, obj)))
+    finally:
+        shutil.rmtree(workdir)
+
+    (over, failed) = print_sizes(flags, results, flash_budget, ram_budget)
+    print ()
+    print_symbols(flags, [result for result in results if result[1] is not None], opts.symbols)
+
+    if over or failed:
+        print ()
+    if failed:
+        print ("%d of %d combinations failed to build" % (failed, len(results)))
+    if over:
+        print ("%d of %d combinations are over the budget" % (over, len(results)))
+    if over or failed:
+        sys.exit(1)
+
+
+def print_sizes(flags, results, flash_budget, ram_budget):
+    """The sizes of every combination; returns how many are over the budget,
+    and how many failed to build."""
+    (over, failed) = (0, 0)
+
+    for (i, flag) in enumerate(flags, 1):
+        print ("%2d: %s" % (i, flag))
+    print ()
+    print (" ".join("%2d" % i for i in range(1, len(flags) + 1)) +
+           "   %7s %7s %7s %7s %7s" % ("flash", "ram", "text", "data", "bss"))
+    for (combo, size, _) in results:
+        enabled = " ".join(" y" if combo[flag] else " -" for flag in flags)
+        if size is None:
+            failed += 1
+            print (enabled + "   build failed")
+            continue
+        (text, data, bss) = size
+        flash, ram = text + data, data + bss
+        problems = []
+        if flash_budget and flash > flash_budget:
+            problems.append("flash over by %d" % (flash - flash_budget))
+        if ram_budget and ram > ram_budget:
+            problems.append("RAM over by %d" % (ram - ram_budget))
+        if problems:
+            over += 1
+        print (enabled +
+               "   %7d %7d %7d %7d %7d" % (flash, ram, text, data, bss) +
+               ("  " + ", ".join(problems) if problems else ""))
+
+    if flash_budget or ram_budget:
+        print ()
+        print ("budget: %s flash, %s RAM" % (flash_budget or "any", ram_budget or "any"))
+    return (over, failed)
+
+
+def print_symbols(flags, results, count):
+    """The largest symbols of keymap.c, with their size range over the
+    combinations, and the features they only exist with."""
+    names = {}
+    for (combo, _, syms) in results:
+        for (name, (section, size)) in syms.items():
+            (_, largest) = names.get(name, (section, 0))
+            names[name] = (section, max(largest, size))
+
+    print ("keymap.c symbols, largest first:")
+    print ("  %-28s %-5s %7s %7s  %s" % ("symbol", "", "min", "max", "only with"))
+    for name in sorted(names, key = lambda n: (-names[n][1], n))[:count]:
+        present = [combo for (combo, _, syms) in results if name in syms]
+        sizes = [syms.get(name, (None, 0))[1] for (_, _, syms) in results]
+        needs = [flag for flag in flags
+                 if all(combo[flag] for combo in present) and
+                 not all(combo[flag] for (combo, _, _) in results)]
+        print ("  %-28s %-5s %7d %7d  %s" % (name, names[name][0], min(sizes), max(sizes),
+                                            " ".join(needs)))
+
+
+if __name__ == "__main__":
+    main()
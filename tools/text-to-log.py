@@ -1,107 +1,236 @@
 #!/usr/bin/env python3
+#
+# Converts text into keylogger output, as if it was typed on the keyboard,
+# so it can be fed to the heatmap tools.
+#
+# The keys to type each character with are looked up in keymap.c itself:
+# the keymaps[] layers, the number row and Hungarian key transforms, the
+# tap dances, and the layer and one-shot shift keys, so the result follows
+# the firmware.
+# Keycodes are turned into characters by the layout the host uses with the
+# layer: Dvorak for the base layer, US for the rest.
 
-import os
+import argparse
+import re
 import sys
 
-charmap = {
-    '9': [[1, 0]],
-    '7': [[2, 0]], '@': [[2, 5], [2, 0]],
-    '5': [[3, 0]], '*': [[2, 5], [3, 0]],
-    '3': [[4, 0]], '^': [[2, 5], [4, 0]],
-    '1': [[5, 0]], '$': [[2, 5], [5, 0]],
-    '0': [[8, 0]], '%': [[2, 5], [8, 0]],
-    '2': [[9, 0]], '!': [[2, 5], [9, 0]],
-    '4': [[10, 0]], '#': [[2, 5], [10, 0]],
-    '6': [[11, 0]], '&': [[2, 5], [11, 0]],
-    '8': [[12, 0]],
-
-    '\\': [[0, 1]], '|': [[2, 5], [0, 1]],
-    'x': [[1, 1]], 'X': [[2, 5], [1, 1]],
-    'w': [[2, 1]], 'W': [[2, 5], [2, 1]],
-    'c': [[3, 1]], 'C': [[2, 5], [3, 1]],
-    'h': [[4, 1]], 'H': [[2, 5], [4, 1]],
-    'f': [[5, 1]], 'F': [[2, 5], [5, 1]],
-    '[': [[6, 1]], '{': [[2, 5], [6, 1]], '(': [[6, 1], [6, 1]],
-    ']': [[7, 1]], '}': [[2, 5], [7, 1]], ')': [[7, 1], [7, 1]],
-    'm': [[8, 1]], 'M': [[2, 5], [8, 1]],
-    'g': [[9, 1]], 'G': [[2, 5], [9, 1]],
-    'l': [[10, 1]], 'L': [[2, 5], [10, 1]],
-    'p': [[11, 1]], 'P': [[2, 5], [11, 1]],
-    '/': [[12, 1]], '?': [[2, 5], [12, 1]],
-    '`': [[13, 1]], '~': [[2, 5], [13, 1]],
-
-    '\t': [[0, 2]],
-    'a': [[1, 2]], 'A': [[2, 5], [1, 2]],
-    'o': [[2, 2]], 'O': [[2, 5], [2, 2]],
-    'e': [[3, 2]], 'E': [[2, 5], [3, 2]],
-    'i': [[4, 2]], 'I': [[2, 5], [4, 2]],
-    'u': [[5, 2]], 'U': [[2, 5], [5, 2]],
-    'd': [[8, 2]], 'D': [[2, 5], [8, 2]],
-    'r': [[9, 2]], 'R': [[2, 5], [9, 2]],
-    't': [[10, 2]], 'T': [[2, 5], [10, 2]],
-    'n': [[11, 2]], 'N': [[2, 5], [11, 2]],
-    's': [[12, 2]], 'S': [[2, 5], [12, 2]],
-    '=': [[13, 2]], '+': [[2, 5], [13, 2]],
-
-    'z': [[1, 3]], 'Z': [[2, 5], [1, 3]],
-    'q': [[2, 3]], 'Q': [[2, 5], [2, 3]],
-    '\'': [[3, 3]], '"': [[2, 5], [3, 3]],
-    ',': [[4, 3]], '<': [[2, 5], [4, 3]],
-    '.': [[5, 3]], '>': [[2, 5], [5, 3]],
-    'b': [[8, 3]], 'B': [[2, 5], [8, 3]],
-    'k': [[9, 3]], 'K': [[2, 5], [9, 3]],
-    'v': [[10, 3]], 'V': [[2, 5], [10, 3]],
-    'y': [[11, 3]], 'Y': [[2, 5], [11, 3]],
-    'j': [[12, 3]], 'J': [[2, 5], [12, 3]],
-
-    ':': [[4, 4]], ';': [[4, 4], [4, 4]],
-    '-': [[9, 4]], '_': [[2, 5], [9, 4]],
-
-    ' ': [[10, 5]],
-    '\n': [[11, 5]],
-
-    ## Layered things
-    # Hungarian
-    'á': [[9, 5], [1, 2]],  'Á': [[2, 5], [9, 5], [1, 2]],
-    'ó': [[9, 5], [2, 2]],  'Ó': [[2, 5], [9, 5], [2, 2]],
-    'ő': [[9, 5], [2, 1]],  'Ő': [[2, 5], [9, 5], [2, 1]],
-    'ö': [[9, 5], [2, 3]],  'Ö': [[2, 5], [9, 5], [2, 3]],
-    'é': [[9, 5], [3, 2]],  'É': [[2, 5], [9, 5], [3, 2]],
-    'ú': [[9, 5], [4, 2]],  'Ú': [[2, 5], [9, 5], [4, 2]],
-    'ű': [[9, 5], [4, 1]],  'Ű': [[2, 5], [9, 5], [4, 1]],
-    'ü': [[9, 5], [4, 3]],  'Ü': [[2, 5], [9, 5], [4, 3]],
-    'í': [[9, 5], [5, 2]],  'Í': [[2, 5], [9, 5], [5, 2]],
+from os.path import dirname, join
+from keymap_tables import LOG_LAYER_NAMES, parse_keymaps, parse_macros, strip_comments
+
+CHUNK_SIZE = 1 << 20
+
+us_keys = {
+    "KC_MINS": "-_", "KC_EQL": "=+", "KC_LBRC": "[{", "KC_RBRC": "]}",
+    "KC_BSLS": "\\|", "KC_SCLN": ";:", "KC_QUOT": "'\"", "KC_GRV": "`~",
+    "KC_COMM": ",<", "KC_DOT": ".>", "KC_SLSH": "/?",
+}
+for c in "abcdefghijklmnopqrstuvwxyz":
+    us_keys["KC_" + c.upper()] = c + c.upper()
+for (c, s) in zip("1234567890", "!@#$%^&*()"):
+    us_keys["KC_" + c] = c + s
+
+dvorak_keys = dict(us_keys)
+for (us, dv) in zip("-=qwertyuiop[]asdfghjkl;'zxcvbnm,./",
+                    "[]',.pyfgcrl/=aoeuidhtns-;qjkxbmwvz"):
+    kc = [k for k in us_keys if us_keys[k][0] == us][0]
+    dvorak_keys[kc] = [v for v in us_keys.values() if v[0] == dv][0]
+
+# Keys that type the same with or without shift
+for keys in (us_keys, dvorak_keys):
+    keys.update({"KC_ENT": "\n", "KC_TAB": "\t", "KC_SPC": " "})
+
+host_layouts = {"Dvorak": dvorak_keys}
+
+keycode_aliases = {
+    "KC_DQT": "LSFT(KC_QUOT)", "KC_COLN": "LSFT(KC_SCLN)",
+    "KC_LPRN": "LSFT(KC_9)", "KC_RPRN": "LSFT(KC_0)",
+}
+
+# Tap dances implemented with functions in keymap.c, rather than with
+# ACTION_TAP_DANCE_DOUBLE(): the keycode of the first, second, ... tap.
+tap_dance_fns = {
+    "CT_TA": ["KC_TAB"],
+    "CT_LBP": ["KC_LBRC", "KC_LPRN"],
+    "CT_RBP": ["KC_RBRC", "KC_RPRN"],
 }
 
-def lookup_char(layer, ch):
-    if ch in charmap:
-        return charmap[ch]
-    return None
-
-def process_char(layer, ch, out=sys.stdout):
-    keys = lookup_char(layer, ch)
-    if not keys:
-        print ("Unknown char: %s" % ch, file=sys.stderr)
-    else:
-        for (c, r) in keys:
-            print ("KL: col=%d, row=%d, pressed=1, layer=%s" % (r, c, layer), file=out)
-            print ("KL: col=%d, row=%d, pressed=0, layer=%s" % (r, c, layer), file=out)
-
-def process_file(fn, layer, out=sys.stdout):
-    with open(fn, "r") as f:
-        ch = f.read(1)
-        while ch:
-            process_char(layer, ch, out)
-            ch = f.read(1)
-
-if sys.argv[1] == '-':
-    out='/dev/stdin'
-else:
-    out=sys.argv[1]
-
-if len(sys.argv) >= 2:
-    layer = 'ADORE'
-else:
-    layer = sys.argv[2]
-
-process_file(out, layer = layer)
+
+def parse_firmware(fn):
+    """The parts of keymap.c beyond keymaps[] the characters depend on."""
+    with open(fn) as f:
+        text = strip_comments(f.read())
+
+    fn_actions = dict(re.findall(r"\[(F_\w+)\]\s*=\s*(ACTION_\w+\s*\([^)]*\))", text))
+
+    tap_dance = dict((k, list(v)) for (k, v) in tap_dance_fns.items())
+    for (td, first, second) in re.findall(
+            r"\[(CT_\w+)\]\s*=\s*ACTION_TAP_DANCE_DOUBLE\s*\(\s*(\w+)\s*,\s*(\w+)\s*\)", text):
+        tap_dance[td] = [first, second]
+
+    # The number row and Hungarian keys: macros.def names the row of each
+    # in key_transforms[]. Number row keys type their key, and with shift,
+    # the other one (with shift still held).
+    body = re.search(r"key_transforms\[\w*\]\s*=\s*\{(.*?)\n\};", text, re.S).group(1)
+    xforms = dict((name, (kind, args)) for (name, kind, args) in re.findall(
+        r"\[(XF_\w+)\]\s*=\s*XF_(KEY|HUN)\s*\(([^)]*)\)", body))
+    num_row, hun = {}, {}
+    for (macro, handler, arg) in parse_macros(join(dirname(fn), "macros.def")):
+        if handler != "ang_macro_xform":
+            continue
+        (kind, args) = xforms[arg]
+        args = [a.strip() for a in args.split(",")]
+        if kind == "KEY":
+            num_row[macro] = (args[0], args[1] if args[1] != "KC_NO" else None)
+        else:
+            hun[macro] = (chr(int(args[2], 16)), chr(int(args[3], 16)))
+
+    return fn_actions, tap_dance, num_row, hun
+
+
+class ReverseIndex(object):
+    """Which keys to tap, in which layer, to type each character."""
+
+    def __init__(self, keymap_fn, layout):
+        self.layers = parse_keymaps(keymap_fn)
+        (self.fn_actions, self.tap_dance, self.num_row, self.hun) = parse_firmware(keymap_fn)
+        self.layer_index = dict((name, i) for (i, (name, _)) in enumerate(self.layers))
+
+        base = [name for (name, _) in self.layers
+                if LOG_LAYER_NAMES.get(name, name) == layout]
+        if not base:
+            raise KeyError(layout)
+        self.base = base[0]
+        self.host_keys = host_layouts.get(layout, us_keys)
+
+        # char -> the taps to type it with: (position, layer pressed in, layer released in)
+        self.index = {}
+        self.build()
+
+    def char(self, keycode, shift):
+        """The character a plain keycode types, or None."""
+        keycode = keycode_aliases.get(keycode, keycode)
+        m = re.match(r"LSFT\((\w+)\)$", keycode)
+        if m:
+            (keycode, shift) = (m.group(1), True)
+        chars = self.host_keys.get(keycode)
+        if not chars:
+            return None
+        return chars[-1] if shift else chars[0]
+
+    def add(self, ch, taps):
+        if ch is None:
+            return
+        if ch not in self.index or len(taps) < len(self.index[ch]):
+            self.index[ch] = taps
+
+    def shift_key(self, layer):
+        shifts = ["F(%s)" % f for f in self.fn_actions
+                  if re.sub(r"\s+", "", self.fn_actions[f]) == "ACTION_MODS_ONESHOT(MOD_LSFT)"]
+        for (keycode, pos) in dict(self.layers)[layer]:
+            if keycode in shifts:
+                return pos
+        return None
+
+    def layer_keys(self, layer):
+        """Keys on layer that make another layer active for the next key."""
+        keys = []
+        for (keycode, pos) in dict(self.layers)[layer]:
+            m = re.match(r"F\((\w+)\)$", keycode)
+            action = self.fn_actions.get(m.group(1), "") if m else ""
+            m = re.match(r"ACTION_LAYER_INVERT\s*\(\s*(\w+)", action) or re.match(r"OSL\((\w+)\)$", keycode)
+            if m and m.group(1) in self.layer_index:
+                keys.append((pos, m.group(1)))
+        return keys
+
+    def add_layer(self, layer, prefix, shift):
+        """Index the characters typed with the keys of layer, after the taps
+        in prefix. The layer stays active until the first key on it."""
+        for (keycode, pos) in dict(self.layers)[layer]:
+            m = re.match(r"(M|TD)\((\w+)\)$", keycode)
+            (kind, arg) = m.groups() if m else (None, None)
+
+            if kind == "M" and arg in self.num_row:
+                (lower, upper) = self.num_row[arg]
+                self.add(self.char(lower, False), prefix + [(pos, layer, self.base)])
+                if shift is not None and upper:
+                    self.add(self.char(upper, True),
+                             [(shift, self.base, self.base)] + prefix + [(pos, layer, self.base)])
+            elif kind == "M" and arg in self.hun:
+                # ang_xform_hun() turns the Hungarian layer off
+                (lower, upper) = self.hun[arg]
+                self.add(lower, prefix + [(pos, layer, self.base)])
+                if shift is not None:
+                    self.add(upper, [(shift, self.base, self.base)] + prefix + [(pos, layer, self.base)])
+            elif kind == "TD" and arg in self.tap_dance:
+                for (n, tap) in enumerate(self.tap_dance[arg], 1):
+                    taps = prefix + [(pos, layer, self.base)] * n
+                    self.add(self.char(tap, False), taps)
+                    if shift is not None:
+                        self.add(self.char(tap, True), [(shift, self.base, self.base)] + taps)
+            elif not kind:
+                after = self.base if prefix else layer
+                self.add(self.char(keycode, False), prefix + [(pos, layer, after)])
+                if shift is not None:
+                    self.add(self.char(keycode, True),
+                             [(shift, self.base, self.base)] + prefix + [(pos, layer, after)])
+
+    def build(self):
+        shift = self.shift_key(self.base)
+        self.add_layer(self.base, [], shift)
+        for (pos, layer) in self.layer_keys(self.base):
+            self.add_layer(layer, [(pos, self.base, layer)], shift)
+
+    def log(self, ch):
+        """The keylogger output for typing ch."""
+        out = []
+        for ((c, r), pressed_in, released_in) in self.index[ch]:
+            out.append("KL: col=%d, row=%d, pressed=1, layer=%s\n" %
+                       (r, c, LOG_LAYER_NAMES.get(pressed_in, pressed_in)))
+            out.append("KL: col=%d, row=%d, pressed=0, layer=%s\n" %
+                       (r, c, LOG_LAYER_NAMES.get(released_in, released_in)))
+        return "".join(out)
+
+
+def process_file(f, table, out):
+    while True:
+        chunk = f.read(CHUNK_SIZE)
+        if not chunk:
+            break
+        for ch in set(chunk):
+            if ord(ch) not in table:
+                print ("Unknown char: %s" % ch, file=sys.stderr)
+                # Left out of the output from now on
+                table[ord(ch)] = None
+        out.write(chunk.translate(table))
+
+
+def main():
+    parser = argparse.ArgumentParser(description = "text to keylog converter")
+    parser.add_argument('files', metavar = 'FILE', nargs = '*', default = ['-'],
+                        help = 'Text to convert, - or nothing for the standard input')
+    parser.add_argument('--layout', dest = 'layout', default = 'ADORE',
+                        help = 'The layout (default layer) to type with: ADORE (the default) or Dvorak')
+    parser.add_argument('--keymap', dest = 'keymap', default = join(dirname(sys.argv[0]), "..", "keymap.c"),
+                        help = 'The keymap.c to look the keys up in')
+    opts = parser.parse_args()
+
+    try:
+        index = ReverseIndex(opts.keymap, opts.layout)
+    except KeyError:
+        print ("Unknown layout: %s" % opts.layout, file=sys.stderr)
+        sys.exit(1)
+
+    table = dict((ord(ch), index.log(ch)) for ch in index.index)
+
+    out = open(sys.stdout.fileno(), "w", buffering = CHUNK_SIZE, closefd = False)
+    for fn in opts.files:
+        if fn == '-':
+            process_file(open(sys.stdin.fileno(), "r", closefd = False), table, out)
+        else:
+            with open(fn, "r") as f:
+                process_file(f, table, out)
+    out.flush()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+#
+# Compiles the Unicode symbol table (ucis.def) into a trie, stored in
+# PROGMEM, that keymap.c walks one key at a time as a symbol name is typed.
+# Every node has the number of the symbol whose name ends there (0 if there
+# is none), which indexes ucis_symbol_codes[], minus one.
+#
+# Usage: ucis-trie.py [--check] ucis.def ucis-trie.h
+#
+# The output is only rewritten when it changes. With --check, it is not
+# written at all, and the tool fails if it is out of date: the build runs
+# it that way.
+
+import os
+import re
+import sys
+
+from keymap_tables import TrieNode, fail, generator_args, trie_tables, update
+
+
+def parse(fn):
+    root = TrieNode([])
+    symbols = []
+
+    with open(fn) as f:
+        for lineno, line in enumerate(f, 1):
+            words = line.split("#", 1)[0].split()
+            if not words:
+                continue
+            if len(words) != 2:
+                fail(fn, lineno, "expected a name and a code point")
+            name, code = words
+            if not re.match("^[a-z0-9]+$", name):
+                fail(fn, lineno, "%s: names may only use a-z and 0-9" % name)
+            try:
+                code = int(code, 16)
+            except ValueError:
+                fail(fn, lineno, "%s: bad code point %s" % (name, code))
+            if not 0 < code <= 0x10ffff:
+                fail(fn, lineno, "%s: code point out of range" % name)
+
+            node = root.insert(["KC_" + c.upper() for c in name])
+            if node.value:
+                fail(fn, lineno, "duplicate name %s" % name)
+            symbols.append((name, code))
+            node.value = len(symbols)
+
+    if len(symbols) >= 1 << 16:
+        sys.stderr.write("%s: too many symbols\n" % fn)
+        sys.exit(1)
+
+    return root, symbols
+
+
+def generate(root, symbols, source):
+    out = []
+    out.append("/* Generated from %s by tools/ucis-trie.py, do not edit! */" % source)
+    out.append("")
+    out.append("#pragma once")
+    out.append("")
+    out.append("static const uint32_t PROGMEM ucis_symbol_codes[] = {")
+    for name, code in symbols:
+        out.append("  0x%05x, // %s" % (code, name))
+    if not symbols:
+        out.append("  0,")
+    out.append("};")
+    out.append("")
+    out.extend(trie_tables("ucis", root, "symbol", "uint16_t", "uint16_t",
+                           lambda symbol: str(symbol or 0)))
+    return "\n".join(out)
+
+
+def main():
+    (source, target, check) = generator_args("ucis.def", "ucis-trie.h")
+
+    root, symbols = parse(source)
+    update(target, generate(root, symbols, os.path.basename(source)), check)
+
+
+if __name__ == "__main__":
+    main()
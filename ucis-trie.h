@@ -0,0 +1,97 @@
+/* Generated from ucis.def by tools/ucis-trie.py, do not edit! */
+
+#pragma once
+
+static const uint32_t PROGMEM ucis_symbol_codes[] = {
+  0x1f4a9, // poop
+  0x1f923, // rofl
+  0x1f619, // kiss
+  0x02603, // snowman
+  0x02615, // coffee
+  0x02764, // heart
+  0x026a1, // bolt
+  0x003c0, // pi
+  0x1f401, // mouse
+  0x000b5, // micro
+  0x02122, // tm
+  0x1f476, // child
+  0x1f46a, // family
+};
+
+typedef struct {
+  uint16_t symbol;
+  uint8_t  first_key;
+  uint8_t  keys;
+  uint16_t edges;
+} ucis_trie_node_t;
+
+#define UCIS_TRIE_ROOT 0
+
+static const ucis_trie_node_t PROGMEM ucis_trie_nodes[] = {
+  { 0,                   0x05, 19,    0 }, // start
+  { 0,                   0x12,  1,   19 }, // KC_B
+  { 0,                   0x0b,  8,   20 }, // KC_C
+  { 0,                   0x04,  1,   28 }, // KC_F
+  { 0,                   0x08,  1,   29 }, // KC_H
+  { 0,                   0x0c,  1,   30 }, // KC_K
+  { 0,                   0x0c,  7,   31 }, // KC_M
+  { 0,                   0x0c,  7,   38 }, // KC_P
+  { 0,                   0x12,  1,   45 }, // KC_R
+  { 0,                   0x11,  1,   46 }, // KC_S
+  { 0,                   0x10,  1,   47 }, // KC_T
+  { 0,                   0x0f,  1,   48 }, // KC_B KC_O
+  { 0,                   0x0c,  1,   49 }, // KC_C KC_H
+  { 0,                   0x09,  1,   50 }, // KC_C KC_O
+  { 0,                   0x10,  1,   51 }, // KC_F KC_A
+  { 0,                   0x04,  1,   52 }, // KC_H KC_E
+  { 0,                   0x16,  1,   53 }, // KC_K KC_I
+  { 0,                   0x06,  1,   54 }, // KC_M KC_I
+  { 0,                   0x18,  1,   55 }, // KC_M KC_O
+  { 8,                   0x00,  0,   56 }, // KC_P KC_I
+  { 0,                   0x12,  1,   56 }, // KC_P KC_O
+  { 0,                   0x09,  1,   57 }, // KC_R KC_O
+  { 0,                   0x12,  1,   58 }, // KC_S KC_N
+  { 11,                  0x00,  0,   59 }, // KC_T KC_M
+  { 0,                   0x17,  1,   59 }, // KC_B KC_O KC_L
+  { 0,                   0x0f,  1,   60 }, // KC_C KC_H KC_I
+  { 0,                   0x09,  1,   61 }, // KC_C KC_O KC_F
+  { 0,                   0x0c,  1,   62 }, // KC_F KC_A KC_M
+  { 0,                   0x15,  1,   63 }, // KC_H KC_E KC_A
+  { 0,                   0x16,  1,   64 }, // KC_K KC_I KC_S
+  { 0,                   0x15,  1,   65 }, // KC_M KC_I KC_C
+  { 0,                   0x16,  1,   66 }, // KC_M KC_O KC_U
+  { 0,                   0x13,  1,   67 }, // KC_P KC_O KC_O
+  { 0,                   0x0f,  1,   68 }, // KC_R KC_O KC_F
+  { 0,                   0x1a,  1,   69 }, // KC_S KC_N KC_O
+  { 7,                   0x00,  0,   70 }, // KC_B KC_O KC_L KC_T
+  { 0,                   0x07,  1,   70 }, // KC_C KC_H KC_I KC_L
+  { 0,                   0x08,  1,   71 }, // KC_C KC_O KC_F KC_F
+  { 0,                   0x0f,  1,   72 }, // KC_F KC_A KC_M KC_I
+  { 0,                   0x17,  1,   73 }, // KC_H KC_E KC_A KC_R
+  { 3,                   0x00,  0,   74 }, // KC_K KC_I KC_S KC_S
+  { 0,                   0x12,  1,   74 }, // KC_M KC_I KC_C KC_R
+  { 0,                   0x08,  1,   75 }, // KC_M KC_O KC_U KC_S
+  { 1,                   0x00,  0,   76 }, // KC_P KC_O KC_O KC_P
+  { 2,                   0x00,  0,   76 }, // KC_R KC_O KC_F KC_L
+  { 0,                   0x10,  1,   76 }, // KC_S KC_N KC_O KC_W
+  { 12,                  0x00,  0,   77 }, // KC_C KC_H KC_I KC_L KC_D
+  { 0,                   0x08,  1,   77 }, // KC_C KC_O KC_F KC_F KC_E
+  { 0,                   0x1c,  1,   78 }, // KC_F KC_A KC_M KC_I KC_L
+  { 6,                   0x00,  0,   79 }, // KC_H KC_E KC_A KC_R KC_T
+  { 10,                  0x00,  0,   79 }, // KC_M KC_I KC_C KC_R KC_O
+  { 9,                   0x00,  0,   79 }, // KC_M KC_O KC_U KC_S KC_E
+  { 0,                   0x04,  1,   79 }, // KC_S KC_N KC_O KC_W KC_M
+  { 5,                   0x00,  0,   80 }, // KC_C KC_O KC_F KC_F KC_E KC_E
+  { 13,                  0x00,  0,   80 }, // KC_F KC_A KC_M KC_I KC_L KC_Y
+  { 0,                   0x11,  1,   80 }, // KC_S KC_N KC_O KC_W KC_M KC_A
+  { 4,                   0x00,  0,   81 }, // KC_S KC_N KC_O KC_W KC_M KC_A KC_N
+};
+
+static const uint16_t PROGMEM ucis_trie_edges[] = {
+   1,  2,  0,  0,  3,  0,  4,  0,  0,  5,  0,  6,  0,  0,  7,  0,
+   8,  9, 10, 11, 12,  0,  0,  0,  0,  0,  0, 13, 14, 15, 16, 17,
+   0,  0,  0,  0,  0, 18, 19,  0,  0,  0,  0,  0, 20, 21, 22, 23,
+  24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39,
+  40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55,
+  56,
+};